@@ -1,4 +1,5 @@
 #include "arm64-asmtests.h"
+#include "results.h"
 
 int safe_memcmp(const void* s1, const void* s2, size_t n){
     volatile const char* p1 = s1;
@@ -11,11 +12,13 @@ int safe_memcmp(const void* s1, const void* s2, size_t n){
 }
 
 /* 
- * this just works for instructions that use offset registers to determine the address, 
- * but that's all I've seen and added fixups for so far, so that's fine.
+ * Most of these use offset registers to determine the address, that's what I've seen and added
+ * fixups for first.
  * 
- * I have a decent idea how I could somewhat decently test pre- and post-indexed instructions,
- * but I currently don't need those.
+ * Pre- and post-indexed instructions (single registers and pairs) and ld1/st1 with post-index
+ * also change the base register. Those return the base register after the instruction, and the
+ * check makes sure it got written back correctly, a fixup can get the data right and still
+ * mess that up.
  * 
  * 
  * All of these functions take 16 bytes and store them at a given address with a given offset
@@ -24,6 +27,7 @@ int safe_memcmp(const void* s1, const void* s2, size_t n){
 
 
 typedef void(*str16)(void* dst, void* src, int offset);
+typedef void*(*wb16)(void* dst, void* src, int offset);
 
 void dump(void* ptr, size_t n){
     for(int i = 0; i < n; i++){
@@ -41,29 +45,10 @@ int memcheck(void* ptr, char c, size_t n){
     return 0;
 }
 
-/*
- *
- * addr needs to point to a block at least 256 bytes large
- */
-bool runInstrCheck(str16 strfun, void* addr, int imm_offset, int dataSize){
-
-    int offs = 3;
-    int blkSize = 256;
-    // some test data that makes it easy to spot errors
-    char* srcData = malloc(dataSize*2);
-
+// data has to be at addr + offs + imm_offset and everything else in the block still 0xff
+static bool verifyStore(void* addr, int offs, int imm_offset, char* srcData, int dataSize, int blkSize){
     bool success = true;
 
-    memset(srcData, 0x55, dataSize*2);
-    for(int i = 0; i < dataSize; i++){
-        srcData[i]=i+1;
-    }
-
-    // to check that only what should be touched gets touched
-    memset(addr, 0xff,blkSize);
-
-    strfun(addr + offs, srcData, imm_offset);  // +3 to have it not aligned, +1 would work just as well, but this gives more space to spot overruns
-
     if(safe_memcmp(addr + offs + imm_offset, srcData, dataSize)){
         printf("Data mismatch!\n");
         printf("Source: \t");
@@ -88,33 +73,88 @@ bool runInstrCheck(str16 strfun, void* addr, int imm_offset, int dataSize){
         printf("\n(should all be 0x%hhx)\n", 0xff);
         success = false;
     }
+    return success;
+}
 
-    free(srcData);
-    // all checks are done
+// for the summary at the end of runAsmTests
+static int probesRun, probesFailed;
+
+static bool countProbe(bool success){
+    probesRun++;
+    if(!success){
+        probesFailed++;
+    }
     return success;
 }
 
+static bool checkWriteback(void* base, void* expected){
+    if(base != expected){
+        printf("Wrong base register writeback! Base is %p, should be %p (off by %ld)\n",
+            base, expected, (long)(base - expected));
+        return false;
+    }
+    return true;
+}
 
-bool runLdrInstrCheck(str16 strfun, void* addr, int imm_offset, int dataSize){
+static char* makeSrcData(int dataSize){
+    char* srcData = malloc(dataSize*2);
+    memset(srcData, 0x55, dataSize*2);
+    for(int i = 0; i < dataSize; i++){
+        srcData[i]=i+1;
+    }
+    return srcData;
+}
+
+/*
+ *
+ * addr needs to point to a block at least 256 bytes large
+ */
+bool runInstrCheck(str16 strfun, void* addr, int imm_offset, int dataSize){
 
     int offs = 3;
     int blkSize = 256;
     // some test data that makes it easy to spot errors
-    char* dst = malloc(dataSize*4);
+    char* srcData = makeSrcData(dataSize);
 
-    char* srcData = addr + offs;
+    // to check that only what should be touched gets touched
+    memset(addr, 0xff,blkSize);
 
-    bool success = true;
+    strfun(addr + offs, srcData, imm_offset);  // +3 to have it not aligned, +1 would work just as well, but this gives more space to spot overruns
+
+    bool success = verifyStore(addr, offs, imm_offset, srcData, dataSize, blkSize);
+
+    free(srcData);
+    // all checks are done
+    return countProbe(success);
+}
+
+/*
+ * same as runInstrCheck, but for instructions that write back the base register.
+ * wbOffset is where the base register should end up, relative to where the data goes
+ */
+bool runWbInstrCheck(wb16 strfun, void* addr, int dataSize, long wbOffset){
+
+    int offs = 3;
+    int blkSize = 256;
+    char* srcData = makeSrcData(dataSize);
 
-    // to check that only what should be touched gets touched
     memset(addr, 0xff,blkSize);
-    memset(dst, 0xaa,dataSize*4);
-    for(int i = 0; i < dataSize; i++){
-        srcData[i]=i+1;
-    }
 
+    void* base = strfun(addr + offs, srcData, 0);
 
-    strfun(dst, srcData, imm_offset);  // +3 to have it not aligned, +1 would work just as well, but this gives more space to spot overruns
+    bool success = verifyStore(addr, offs, 0, srcData, dataSize, blkSize);
+    success &= checkWriteback(base, addr + offs + wbOffset);
+
+    free(srcData);
+    return countProbe(success);
+}
+
+/*
+ * For loads the data has to end up in dst (normal memory), without anything after it being touched.
+ * The mapping itself must not change either, a broken fixup could just as well write back to it.
+ */
+static bool verifyLoad(void* addr, int offs, char* srcData, char* dst, int dataSize, int blkSize){
+    bool success = true;
 
     if(safe_memcmp(dst, srcData, dataSize)){
         printf("Data mismatch!\n");
@@ -126,27 +166,82 @@ bool runLdrInstrCheck(str16 strfun, void* addr, int imm_offset, int dataSize){
         success = false;
     }
 
-    // overruns don't make too much sense for this
-    /*
-    // the data has been copied correctly, but there could still be overruns
-    if(memcheck(addr, 0xff, offs + imm_offset)){
-        printf("Overrun in front of the actual address! Data is: \n");
+    if(memcheck(dst + dataSize, 0xaa, dataSize*3)){
+        printf("Overrun after the destination! Data is: \n");
+        dump(dst + dataSize, dataSize);
+        printf("\n(should all be 0x%hhx)\n", 0xaa);
+        success = false;
+    }
+
+    if(memcheck(addr, 0xff, offs)){
+        printf("Mapping changed in front of the source! Data is: \n");
         dump(addr, offs);
         printf("\n(should all be 0x%hhx)\n", 0xff);
         success = false;
     }
 
-    if(memcheck(addr+offs + dataSize + imm_offset, 0xff, blkSize - offs - dataSize - imm_offset)){
-        printf("Overrun in after the actual range! Data is: \n");
-        dump(addr + dataSize + offs, offs);
+    for(int i = 0; i < dataSize; i++){
+        if(((volatile char*)srcData)[i] != (char)(i+1)){
+            printf("Source data in the mapping changed!\n");
+            success = false;
+            break;
+        }
+    }
+
+    if(memcheck(addr + offs + dataSize, 0xff, blkSize - offs - dataSize)){
+        printf("Mapping changed after the source! Data is: \n");
+        dump(addr + offs + dataSize, offs);
         printf("\n(should all be 0x%hhx)\n", 0xff);
         success = false;
-    }   
-    */
+    }
+    return success;
+}
+
+static char* prepareLoad(void* addr, int offs, int dataSize, int blkSize, char** dst){
+    char* srcData = addr + offs;
+    *dst = malloc(dataSize*4);
+
+    // to check that only what should be touched gets touched
+    memset(addr, 0xff,blkSize);
+    memset(*dst, 0xaa,dataSize*4);
+    for(int i = 0; i < dataSize; i++){
+        srcData[i]=i+1;
+    }
+    return srcData;
+}
+
+bool runLdrInstrCheck(str16 strfun, void* addr, int imm_offset, int dataSize){
+
+    int offs = 3;
+    int blkSize = 256;
+    char* dst;
+    // some test data that makes it easy to spot errors
+    char* srcData = prepareLoad(addr, offs, dataSize, blkSize, &dst);
+
+    strfun(dst, srcData, imm_offset);  // +3 to have it not aligned, +1 would work just as well, but this gives more space to spot overruns
+
+    bool success = verifyLoad(addr, offs, srcData, dst, dataSize, blkSize);
 
     free(dst);
     // all checks are done
-    return success;
+    return countProbe(success);
+}
+
+// wbOffset is where the base register should end up, relative to the source address
+bool runWbLdrInstrCheck(wb16 strfun, void* addr, int dataSize, long wbOffset){
+
+    int offs = 3;
+    int blkSize = 256;
+    char* dst;
+    char* srcData = prepareLoad(addr, offs, dataSize, blkSize, &dst);
+
+    void* base = strfun(dst, srcData, 0);
+
+    bool success = verifyLoad(addr, offs, srcData, dst, dataSize, blkSize);
+    success &= checkWriteback(base, srcData + wbOffset);
+
+    free(dst);
+    return countProbe(success);
 }
 
 
@@ -679,7 +774,328 @@ void str13(void* dst, void* src, int offset){
         : : "r"(&dst), "r"(src) : "x13", "d1");
 }
 
+/*
+ * Writeback forms. The base register gets returned, so the check can see where it ended up.
+ */
+
+// 3c810c20
+void* strPre1(void* dst, void* src, int offset){
+    printf("128bit SIMD str pre-index (0x3c810c20)\n");
+    void* newdst = dst - 0x10; // pre-index adds the offset before the store
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // newdst address into x1
+        "ldr q0, [%2]\n\t"  // load the data into the register
+        "str q0, [x1, #0x10]!\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&newdst), "r"(src) : "x1", "q0");
+    return base;
+}
+
+// 3c810420
+void* strPost1(void* dst, void* src, int offset){
+    printf("128bit SIMD str post-index (0x3c810420)\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // dst address into x1
+        "ldr q0, [%2]\n\t"  // load the data into the register
+        "str q0, [x1], #0x10\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&dst), "r"(src) : "x1", "q0");
+    return base;
+}
+
+// f81f8c22
+void* strPre2(void* dst, void* src, int offset){
+    printf("64bit str pre-index (0xf81f8c22)\n");
+    void* newdst = dst + 0x8; // to compensate the negative offset
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // newdst address into x1
+        "ldr x2, [%2]\n\t"  // load the data into the register
+        "str x2, [x1, #-8]!\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&newdst), "r"(src) : "x1", "x2");
+    return base;
+}
+
+// f8008422
+void* strPost2(void* dst, void* src, int offset){
+    printf("64bit str post-index (0xf8008422)\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // dst address into x1
+        "ldr x2, [%2]\n\t"  // load the data into the register
+        "str x2, [x1], #8\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&dst), "r"(src) : "x1", "x2");
+    return base;
+}
+
+// a9bf0c22
+void* stpPre1(void* dst, void* src, int offset){
+    printf("64bit stp pre-index (0xa9bf0c22)\n");
+    void* newdst = dst + 0x10; // to compensate the negative offset
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // newdst address into x1
+        "ldp x2, x3, [%2]\n\t"  // load the data into the registers
+        "stp x2, x3, [x1, #-16]!\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&newdst), "r"(src) : "x1", "x2", "x3");
+    return base;
+}
+
+// a8810c22
+void* stpPost1(void* dst, void* src, int offset){
+    printf("64bit stp post-index (0xa8810c22)\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // dst address into x1
+        "ldp x2, x3, [%2]\n\t"  // load the data into the registers
+        "stp x2, x3, [x1], #16\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&dst), "r"(src) : "x1", "x2", "x3");
+    return base;
+}
+
+// ad810420
+void* stpPre2(void* dst, void* src, int offset){
+    printf("128bit SIMD stp pre-index (0xad810420) total 256bit\n");
+    void* newdst = dst - 0x20; // pre-index adds the offset before the store
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // newdst address into x1
+        "ldp q0, q1, [%2]\n\t"  // load the data into the registers
+        "stp q0, q1, [x1, #32]!\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&newdst), "r"(src) : "x1", "q0", "q1");
+    return base;
+}
+
+// ac810420
+void* stpPost2(void* dst, void* src, int offset){
+    printf("128bit SIMD stp post-index (0xac810420) total 256bit\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // dst address into x1
+        "ldp q0, q1, [%2]\n\t"  // load the data into the registers
+        "stp q0, q1, [x1], #32\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&dst), "r"(src) : "x1", "q0", "q1");
+    return base;
+}
+
+// 4c9fa020
+void* st1Post1(void* dst, void* src, int offset){
+    printf("128bit SIMD st1 two registers post-index (0x4c9fa020) total 256bit\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // dst address into x1
+        "ldp q0, q1, [%2]\n\t"  // load the data into the registers
+        "st1 {v0.16b, v1.16b}, [x1], #32\n\t"  // the instruction actually being tested
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&dst), "r"(src) : "x1", "v0", "v1");
+    return base;
+}
+
+// 3cc10c20
+void* ldrPre1(void* dst, void* src, int offset){
+    printf("128bit SIMD ldr pre-index (0x3cc10c20)\n");
+    void* newsrc = src - 0x10; // pre-index adds the offset before the load
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldr q0, [x1, #0x10]!\n\t"  // the instruction actually being tested
+        "str q0, [%2]\n\t"
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&newsrc), "r"(dst) : "x1", "q0");
+    return base;
+}
+
+// 3cc10420
+void* ldrPost1(void* dst, void* src, int offset){
+    printf("128bit SIMD ldr post-index (0x3cc10420)\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldr q0, [x1], #0x10\n\t"  // the instruction actually being tested
+        "str q0, [%2]\n\t"
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&src), "r"(dst) : "x1", "q0");
+    return base;
+}
+
+// f8408422
+void* ldrPost2(void* dst, void* src, int offset){
+    printf("64bit ldr post-index (0xf8408422)\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldr x2, [x1], #8\n\t"  // the instruction actually being tested
+        "str x2, [%2]\n\t"
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&src), "r"(dst) : "x1", "x2");
+    return base;
+}
+
+// a9c10c22
+void* ldpPre1(void* dst, void* src, int offset){
+    printf("64bit ldp pre-index (0xa9c10c22)\n");
+    void* newsrc = src - 0x10; // pre-index adds the offset before the load
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldp x2, x3, [x1, #16]!\n\t"  // the instruction actually being tested
+        "stp x2, x3, [%2]\n\t"
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&newsrc), "r"(dst) : "x1", "x2", "x3");
+    return base;
+}
+
+// acc10420
+void* ldpPost1(void* dst, void* src, int offset){
+    printf("128bit SIMD ldp post-index (0xacc10420) total 256bit\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldp q0, q1, [x1], #32\n\t"  // the instruction actually being tested
+        "stp q0, q1, [%2]\n\t"
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&src), "r"(dst) : "x1", "q0", "q1");
+    return base;
+}
+
+// 4cdfa020
+void* ld1Post1(void* dst, void* src, int offset){
+    printf("128bit SIMD ld1 two registers post-index (0x4cdfa020) total 256bit\n");
+    void* base;
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ld1 {v0.16b, v1.16b}, [x1], #32\n\t"  // the instruction actually being tested
+        "stp q0, q1, [%2]\n\t"
+        "mov %0, x1"  // written back base
+        : "=r"(base) : "r"(&src), "r"(dst) : "x1", "v0", "v1");
+    return base;
+}
+
+/*
+ * Non-temporal pairs and ld1/st1 with multiple registers, no writeback. glibc and Mesa use those
+ * in their copy loops.
+ */
+
+// a8000c22
+void stnp1(void* dst, void* src, int offset){
+    printf("64bit stnp (0xa8000c22)\n");
+    asm volatile(
+        "ldr x1, [%0]\n\t"  // dst address into x1
+        "ldp x2, x3, [%1]\n\t"  // load the data into the registers
+        "stnp x2, x3, [x1]"  // the instruction actually being tested
+        : : "r"(&dst), "r"(src) : "x1", "x2", "x3");
+}
+
+// ac000420
+void stnp2(void* dst, void* src, int offset){
+    printf("128bit SIMD stnp (0xac000420) total 256bit\n");
+    asm volatile(
+        "ldr x1, [%0]\n\t"  // dst address into x1
+        "ldp q0, q1, [%1]\n\t"  // load the data into the registers
+        "stnp q0, q1, [x1]"  // the instruction actually being tested
+        : : "r"(&dst), "r"(src) : "x1", "q0", "q1");
+}
+
+// 4c007020
+void st1_1(void* dst, void* src, int offset){
+    printf("128bit SIMD st1 one register (0x4c007020)\n");
+    asm volatile(
+        "ldr x1, [%0]\n\t"  // dst address into x1
+        "ldr q0, [%1]\n\t"  // load the data into the register
+        "st1 {v0.16b}, [x1]"  // the instruction actually being tested
+        : : "r"(&dst), "r"(src) : "x1", "v0");
+}
+
+// 4c00a020
+void st1_2(void* dst, void* src, int offset){
+    printf("128bit SIMD st1 two registers (0x4c00a020) total 256bit\n");
+    asm volatile(
+        "ldr x1, [%0]\n\t"  // dst address into x1
+        "ldp q0, q1, [%1]\n\t"  // load the data into the registers
+        "st1 {v0.16b, v1.16b}, [x1]"  // the instruction actually being tested
+        : : "r"(&dst), "r"(src) : "x1", "v0", "v1");
+}
+
+// 4c002020
+void st1_4(void* dst, void* src, int offset){
+    printf("128bit SIMD st1 four registers (0x4c002020) total 512bit\n");
+    asm volatile(
+        "ldr x1, [%0]\n\t"  // dst address into x1
+        "ldp q0, q1, [%1]\n\t"  // load the data into the registers
+        "ldp q2, q3, [%1, #32]\n\t"
+        "st1 {v0.16b, v1.16b, v2.16b, v3.16b}, [x1]"  // the instruction actually being tested
+        : : "r"(&dst), "r"(src) : "x1", "v0", "v1", "v2", "v3");
+}
+
+// a8400c22
+void ldnp1(void* dst, void* src, int offset){
+    printf("64bit ldnp (0xa8400c22)\n");
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldnp x2, x3, [x1]\n\t"  // the instruction actually being tested
+        "stp x2, x3, [%0]"
+        : : "r"(dst), "r"(&src) : "x1", "x2", "x3");
+}
+
+// ac400420
+void ldnp2(void* dst, void* src, int offset){
+    printf("128bit SIMD ldnp (0xac400420) total 256bit\n");
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ldnp q0, q1, [x1]\n\t"  // the instruction actually being tested
+        "stp q0, q1, [%0]"
+        : : "r"(dst), "r"(&src) : "x1", "q0", "q1");
+}
+
+// 4c40a020
+void ld1_2(void* dst, void* src, int offset){
+    printf("128bit SIMD ld1 two registers (0x4c40a020) total 256bit\n");
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ld1 {v0.16b, v1.16b}, [x1]\n\t"  // the instruction actually being tested
+        "stp q0, q1, [%0]"
+        : : "r"(dst), "r"(&src) : "x1", "v0", "v1");
+}
+
+// 4c402020
+void ld1_4(void* dst, void* src, int offset){
+    printf("128bit SIMD ld1 four registers (0x4c402020) total 512bit\n");
+    asm volatile(
+        "ldr x1, [%1]\n\t"  // src
+        "ld1 {v0.16b, v1.16b, v2.16b, v3.16b}, [x1]\n\t"  // the instruction actually being tested
+        "stp q0, q1, [%0]\n\t"
+        "stp q2, q3, [%0, #32]"
+        : : "r"(dst), "r"(&src) : "x1", "v0", "v1", "v2", "v3");
+}
+
+// every encoding above that has a probe, fault-profile uses this to tell which ones are new
+const uint32_t asmTestEncodings[] = {
+    0xf840816a, 0xfc408021, 0xf85f816a, 0xfd400021, 0xf940016a, 0xa9000c22,
+    0xa9001444, 0xa9001c46, 0xad000440, 0x3c8041a0, 0x3c80c0e0, 0x3c810140,
+    0x3c820141, 0x3c830142, 0x3c840143, 0x3c810022, 0x3c820021, 0x3c830022,
+    0x3c80c026, 0x3c818027, 0x3c810021, 0x3c80c020, 0x3c818025, 0x3c80c024,
+    0x3c818026, 0x3c820020, 0x3c830021, 0xf81f81aa, 0xfc0081a1, 0x3c9c01a0,
+    0x3d8002e0, 0xf9000845, 0x3ca26861, 0x3d800140, 0xb9000051, 0xf82468a2,
+    0x3d800021, 0x3d800022, 0x3d800020, 0x3d800024, 0x3d800025, 0xf8226865,
+    0xfd0001a1, 0x3c810c20, 0x3c810420, 0xf81f8c22, 0xf8008422, 0xa9bf0c22,
+    0xa8810c22, 0xad810420, 0xac810420, 0x4c9fa020, 0x3cc10c20, 0x3cc10420,
+    0xf8408422, 0xa9c10c22, 0xacc10420, 0x4cdfa020, 0xa8000c22, 0xac000420,
+    0x4c007020, 0x4c00a020, 0x4c002020, 0xa8400c22, 0xac400420, 0x4c40a020,
+    0x4c402020,
+};
+const int asmTestEncodingCount = sizeof(asmTestEncodings) / sizeof(asmTestEncodings[0]);
+
 void runAsmTests(void* addr){
+    probesRun = 0;
+    probesFailed = 0;
     printf("\nstore instructions: \n");
     runInstrCheck(strSIMD128unsignedImm, addr, 0, 16);
     runInstrCheck(stp1,addr,0, 16);
@@ -731,5 +1147,36 @@ void runAsmTests(void* addr){
     runLdrInstrCheck(ldrBehaviour1,addr,0, 16);
     runLdrInstrCheck(ldrBehaviour2,addr,0, 16);
 
-
+    printf("\nnon-temporal and multi-register instructions:\n");
+    runInstrCheck(stnp1,addr,0, 16);
+    runInstrCheck(stnp2,addr,0, 32);
+    runInstrCheck(st1_1,addr,0, 16);
+    runInstrCheck(st1_2,addr,0, 32);
+    runInstrCheck(st1_4,addr,0, 64);
+    runLdrInstrCheck(ldnp1,addr,0, 16);
+    runLdrInstrCheck(ldnp2,addr,0, 32);
+    runLdrInstrCheck(ld1_2,addr,0, 32);
+    runLdrInstrCheck(ld1_4,addr,0, 64);
+
+    printf("\npre- and post-indexed instructions:\n");
+    runWbInstrCheck(strPre1,addr, 16, 0);
+    runWbInstrCheck(strPost1,addr, 16, 16);
+    runWbInstrCheck(strPre2,addr, 8, 0);
+    runWbInstrCheck(strPost2,addr, 8, 8);
+    runWbInstrCheck(stpPre1,addr, 16, 0);
+    runWbInstrCheck(stpPost1,addr, 16, 16);
+    runWbInstrCheck(stpPre2,addr, 32, 0);
+    runWbInstrCheck(stpPost2,addr, 32, 32);
+    runWbInstrCheck(st1Post1,addr, 32, 32);
+    runWbLdrInstrCheck(ldrPre1,addr, 16, 0);
+    runWbLdrInstrCheck(ldrPost1,addr, 16, 16);
+    runWbLdrInstrCheck(ldrPost2,addr, 8, 8);
+    runWbLdrInstrCheck(ldpPre1,addr, 16, 0);
+    runWbLdrInstrCheck(ldpPost1,addr, 32, 32);
+    runWbLdrInstrCheck(ld1Post1,addr, 32, 32);
+
+    printf("\n%d of %d probes failed\n", probesFailed, probesRun);
+    // main runs these at two offsets into the page, keep them apart
+    recordResult(probesFailed, "failures", RESULT_LOWER_BETTER, "asm.failures at page offset 0x%lx",
+        (unsigned long)((uintptr_t)addr & 0xfff));
 }
\ No newline at end of file
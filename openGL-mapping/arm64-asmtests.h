@@ -4,4 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-void runAsmTests(void* addr);
\ No newline at end of file
+void runAsmTests(void* addr);
+
+extern const uint32_t asmTestEncodings[];
+extern const int asmTestEncodingCount;
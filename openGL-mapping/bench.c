@@ -0,0 +1,134 @@
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "bench.h"
+#include "copy.h"
+#include "results.h"
+
+uint64_t nowNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// page faults the kernel had to resolve without IO, which is what touching a fresh mapping costs
+long minorFaults(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+static int alignmentFd = -2;
+
+// alignment faults the kernel had to fix up for this process so far, -1 if perf isn't usable
+long alignmentFaults(){
+    if(alignmentFd == -2){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_ALIGNMENT_FAULTS;
+        attr.inherit = 1;
+        // user space faults are all that's needed, and that works with perf_event_paranoid=2
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        alignmentFd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if(alignmentFd < 0){
+            printf("Alignment fault counter not available (perf_event_paranoid?)\n");
+            alignmentFd = -1;
+        }
+    }
+    if(alignmentFd < 0){
+        return -1;
+    }
+    uint64_t count;
+    if(read(alignmentFd, &count, sizeof(count)) != sizeof(count)){
+        return -1;
+    }
+    return count;
+}
+
+double mbPerSec(size_t bytes, uint64_t ns){
+    if(ns == 0) return 0.0;
+    return (double)bytes / (1024.0 * 1024.0) / ((double)ns / 1e9);
+}
+
+/*
+ * Records MB/s, alignment faults (if the counter works, alignFaults is -1 otherwise) and whether
+ * the data arrived intact for one run of a tool that fills a mapping, returns the MB/s.
+ */
+double recordCopyRun(size_t bytes, uint64_t ns, long alignFaults, bool ok, const char* nameFmt, ...){
+    char name[128];
+    va_list args;
+    va_start(args, nameFmt);
+    vsnprintf(name, sizeof(name), nameFmt, args);
+    va_end(args);
+
+    double mbs = mbPerSec(bytes, ns);
+    recordResult(mbs, "MB/s", RESULT_HIGHER_BETTER, "%s", name);
+    if(alignFaults >= 0){
+        recordResult(alignFaults, "faults", RESULT_LOWER_BETTER, "%s alignment faults", name);
+    }
+    recordResult(!ok, "failures", RESULT_LOWER_BETTER, "%s mismatch", name);
+    return mbs;
+}
+
+#define COPY_BENCH_BYTES (64*1024*1024)
+#define COPY_BENCH_PAGE 4096
+
+static void timeCopies(const char* name, void* dst, const void* src, size_t n, int reps){
+    long faults = alignmentFaults();
+    uint64_t start = nowNs();
+    for(int i = 0; i < reps; i++){
+        this_memcpy_quiet(dst, src, n);
+    }
+    uint64_t ns = nowNs() - start;
+    if(faults >= 0){
+        faults = alignmentFaults() - faults;
+    }
+    printf("%-16s %10.1f MB/s %10ld alignment faults\n", name, mbPerSec(n * reps, ns), faults);
+
+    int keyLen = strcspn(name, ":");
+    recordResult(mbPerSec(n * reps, ns), "MB/s", RESULT_HIGHER_BETTER, "copy.%.*s", keyLen, name);
+    if(faults >= 0){
+        recordResult(faults, "faults", RESULT_LOWER_BETTER, "copy.%.*s alignment faults", keyLen, name);
+    }
+}
+
+/*
+ * The copy benchmarks for any mapping, independent of where it came from.
+ * map should be freshly mapped, so the first touch still has to fault every page in.
+ */
+void runCopyBench(void* map, size_t size){
+    void* tmp = malloc(size);
+    if(!tmp){
+        printf("Could not allocate %zu bytes for the copy benchmark\n", size);
+        return;
+    }
+    memset(tmp, 128, size);
+
+    long faults = minorFaults();
+    uint64_t start = nowNs();
+    for(size_t pos = 0; pos < size; pos += COPY_BENCH_PAGE){
+        *(volatile uint64_t*)(map + pos) = pos;
+    }
+    uint64_t touchNs = nowNs() - start;
+    faults = minorFaults() - faults;
+
+    int reps = COPY_BENCH_BYTES / size;
+    if(reps < 1) reps = 1;
+
+    printf("\nCopy benchmark (%zu bytes, %d reps):\n", size, reps);
+    printf("first touch:     %.1f us, %ld faults\n", (double)touchNs / 1000.0, faults);
+    recordResult((double)touchNs / 1000.0, "us", RESULT_LOWER_BETTER, "copy.first touch");
+    timeCopies("write aligned:", map, tmp, size, reps);
+    timeCopies("write offset 1:", map + 1, tmp + 1, size - 1, reps);
+    timeCopies("read aligned:", tmp, map, size, reps);
+    timeCopies("read offset 1:", tmp + 1, map + 1, size - 1, reps);
+
+    free(tmp);
+}
@@ -0,0 +1,13 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+uint64_t nowNs();
+long minorFaults();
+long alignmentFaults();
+double mbPerSec(size_t bytes, uint64_t ns);
+double recordCopyRun(size_t bytes, uint64_t ns, long alignFaults, bool ok, const char* nameFmt, ...)
+    __attribute__((format(printf, 5, 6)));
+void runCopyBench(void* map, size_t size);
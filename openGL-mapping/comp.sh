@@ -1,7 +1,30 @@
 #!/bin/bash
+SRC="main.c arm64-asmtests.c copy.c bench.c scaling.c upload-threads.c shaders.c gpu-verify.c zerocopy.c soak.c stream-ring.c visibility.c rt-upload.c results.c"
+DRM_SRC="drm-mapping.c arm64-asmtests.c copy.c bench.c mapping-backend.c rt-upload.c results.c"
+VK_SRC="vk-mapping.c arm64-asmtests.c copy.c bench.c results.c"
+REPLAY_SRC="copy-replay.c copy.c bench.c mapping-backend.c results.c"
+PROFILE_SRC="fault-profile.c arm64-asmtests.c results.c"
+LOADER_SRC="file-loader.c loader.c copy.c bench.c mapping-backend.c results.c"
+LZ4_SRC="lz4-stream.c lz4-map.c copy.c bench.c mapping-backend.c results.c"
+# every result gets tagged with the revision it was built from
+GIT_REV="-DGIT_REV=\"$(git rev-parse --short HEAD 2>/dev/null || echo unknown)\""
+# io_uring is optional, the loader just leaves that mode out without it
+if pkg-config --exists liburing; then
+    URING="-DHAVE_LIBURING=1 $(pkg-config --cflags --libs liburing)"
+fi
 if [ $(uname -m) != "aarch64" ]; then
     echo "Cross compiling!"
-    aarch64-linux-gnu-gcc main.c arm64-asmtests.c -lglfw -lGL -lGLEW -g -o mapping
+    CC=aarch64-linux-gnu-gcc
 else
-    gcc main.c arm64-asmtests.c -lglfw -lGL -lGLEW -g -o mapping
-fi
\ No newline at end of file
+    CC=gcc
+fi
+$CC $SRC -I/usr/include/libdrm -lglfw -lGL -lGLEW -lEGL -pthread $GIT_REV -g -o mapping
+$CC $DRM_SRC -I/usr/include/libdrm -pthread $GIT_REV -g -o drm-mapping
+$CC $VK_SRC -lvulkan $GIT_REV -g -o vk-mapping
+# the trace shim must not turn its own copy loops into memcpy calls
+$CC copy-trace.c -shared -fPIC -fno-builtin -ldl -pthread -g -o libcopytrace.so
+$CC $REPLAY_SRC -I/usr/include/libdrm $GIT_REV -g -o copy-replay
+$CC $PROFILE_SRC $GIT_REV -g -o fault-profile
+$CC results-compare.c -lm -g -o results-compare
+$CC $LOADER_SRC -I/usr/include/libdrm $URING $GIT_REV -g -o file-loader
+$CC $LZ4_SRC -I/usr/include/libdrm $GIT_REV -g -o lz4-stream
\ No newline at end of file
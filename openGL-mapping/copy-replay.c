@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "copy-trace.h"
+#include "copy.h"
+#include "mapping-backend.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Replays a trace recorded by libcopytrace.so against every copy kernel in copy.c, on a
+ * mapping from mapping-backend.c. Sizes, alignments and directions come from the trace,
+ * the copies run back to back. Prints the time each kernel needs for the whole trace, the
+ * alignment faults it should cause according to its model and the ones perf actually saw.
+ *
+ * usage: copy-replay <trace file> [--memfd]
+ */
+
+#define REPLAY_PAGE 4096
+
+static struct traceRecord* loadTrace(const char* path, size_t* count, struct traceHeader* header){
+    FILE* f = fopen(path, "rb");
+    if(!f){
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+    if(fread(header, sizeof(*header), 1, f) != 1 || header->magic != TRACE_MAGIC){
+        printf("%s is not a copy trace\n", path);
+        fclose(f);
+        return NULL;
+    }
+    if(header->version != TRACE_VERSION){
+        printf("%s has trace version %u, only %u is supported\n", path, header->version, TRACE_VERSION);
+        fclose(f);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long bytes = ftell(f) - sizeof(*header);
+    fseek(f, sizeof(*header), SEEK_SET);
+    *count = bytes / sizeof(struct traceRecord);
+
+    struct traceRecord* records = malloc(sizeof(struct traceRecord) * (*count + 1));
+    if(fread(records, sizeof(struct traceRecord), *count, f) != *count){
+        printf("Short read on %s\n", path);
+        free(records);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    return records;
+}
+
+// copies between two mappings get the second half of the mapping as source
+static void pickAddresses(struct traceRecord* rec, void* map, void* heap, size_t half, void** dst, void** src){
+    bool toMap = rec->flags & TRACE_TO_MAPPING;
+    bool fromMap = rec->flags & TRACE_FROM_MAPPING;
+    *dst = (toMap ? map : heap) + rec->dstAlign;
+    if(fromMap){
+        *src = (toMap ? map + half : map) + rec->srcAlign;
+    }else{
+        *src = heap + rec->srcAlign;
+    }
+}
+
+static void replayKernel(const struct copyKernel* kernel, struct traceRecord* records, size_t count,
+                         void* map, void* heap, size_t half){
+    long predicted = 0;
+    for(size_t i = 0; i < count && kernel->predictFaults; i++){
+        void* dst;
+        void* src;
+        pickAddresses(&records[i], map, heap, half, &dst, &src);
+        predicted += kernel->predictFaults((uint64_t)dst, (uint64_t)src, records[i].size,
+            records[i].flags & TRACE_TO_MAPPING, records[i].flags & TRACE_FROM_MAPPING);
+    }
+
+    size_t bytes = 0;
+    long faults = alignmentFaults();
+    uint64_t start = nowNs();
+    for(size_t i = 0; i < count; i++){
+        void* dst;
+        void* src;
+        pickAddresses(&records[i], map, heap, half, &dst, &src);
+        kernel->copy(dst, src, records[i].size);
+        bytes += records[i].size;
+    }
+    uint64_t ns = nowNs() - start;
+    if(faults >= 0){
+        faults = alignmentFaults() - faults;
+    }
+
+    printf("%-16s %12.3f %12.1f ", kernel->name, (double)ns / 1e6, mbPerSec(bytes, ns));
+    if(kernel->predictFaults){
+        printf("%16ld", predicted);
+    }else{
+        printf("%16s", "-");
+    }
+    printf(" %16ld\n", faults);
+
+    recordResult((double)ns / 1e6, "ms", RESULT_LOWER_BETTER, "replay.%s", kernel->name);
+    if(faults >= 0){
+        recordResult(faults, "faults", RESULT_LOWER_BETTER, "replay.%s alignment faults", kernel->name);
+    }
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        printf("usage: %s <trace file> [--memfd]\n", argv[0]);
+        return -1;
+    }
+    bool forceMemfd = argc > 2 && !strcmp(argv[2], "--memfd");
+
+    struct traceHeader header;
+    size_t count;
+    struct traceRecord* records = loadTrace(argv[1], &count, &header);
+    if(!records){
+        return -1;
+    }
+    if(count == 0){
+        printf("Trace is empty\n");
+        free(records);
+        return 0;
+    }
+
+    size_t maxSize = 0;
+    size_t total = 0;
+    size_t toMap = 0, fromMap = 0;
+    for(size_t i = 0; i < count; i++){
+        if(records[i].size > maxSize) maxSize = records[i].size;
+        total += records[i].size;
+        if(records[i].flags & TRACE_TO_MAPPING) toMap++;
+        if(records[i].flags & TRACE_FROM_MAPPING) fromMap++;
+    }
+    printf("%zu copies, %zu bytes (%zu into, %zu out of mappings), largest %zu bytes, recorded over %.3f s\n",
+        count, total, toMap, fromMap, maxSize, (double)records[count-1].timestampNs / 1e9);
+
+    // room for the largest copy at any alignment, twice for mapping to mapping copies
+    size_t half = (maxSize + TRACE_ALIGN + REPLAY_PAGE - 1) / REPLAY_PAGE * REPLAY_PAGE;
+    struct mapping m;
+    bool mapped = forceMemfd ? mapMemfd(&m, half * 2) : mapAny(&m, half * 2);
+    if(!mapped){
+        printf("Could not create a mapping\n");
+        free(records);
+        return -1;
+    }
+    printf("Backend: %s\n", backendName(&m));
+    resultsSetTool("copy-replay");
+    resultsSetMapping(&m);
+
+    void* heap = aligned_alloc(TRACE_ALIGN, half);
+    memset(heap, 0x5a, half);
+    // fault everything in up front, that's not what's being measured
+    for(size_t pos = 0; pos < m.size; pos += REPLAY_PAGE){
+        *(volatile uint64_t*)(m.addr + pos) = 0;
+    }
+
+    printf("\n%-16s %12s %12s %16s %16s\n", "kernel", "total ms", "MB/s", "predicted faults", "measured faults");
+    for(int i = 0; i < copyKernelCount; i++){
+        replayKernel(&copyKernels[i], records, count, m.addr, heap, half);
+    }
+
+    free(heap);
+    free(records);
+    unmapMapping(&m);
+    return 0;
+}
@@ -0,0 +1,408 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "copy-trace.h"
+
+/*
+ * Preload shim that records every copy into (or out of) a mapping the GPU driver handed out.
+ *
+ *   LD_PRELOAD=./libcopytrace.so COPY_TRACE_FILE=trace.bin ./mapping
+ *
+ * Mappings get registered when they come out of glMapBufferRange/glMapBuffer (also when
+ * resolved through glXGetProcAddress/eglGetProcAddress, which is how GLEW gets them),
+ * vkMapMemory, or copyTraceRegister. libc memcpy/memmove and this_memcpy (through
+ * copyTraceHook) are recorded when one side is inside a registered mapping.
+ *
+ * GL mappings are kept per buffer name, looked up through the target's binding, so unmapping
+ * one buffer doesn't stop tracing another one mapped through the same target. Deleting a
+ * mapped buffer drops its range too.
+ */
+
+#define TRACE_MAX_RANGES 64
+#define TRACE_BUFFER_RECORDS 4096
+#define TRACE_MAX_VK_ALLOCS 256
+
+typedef void* (*memcpy_fn)(void*, const void*, size_t);
+typedef void* (*glMapBufferRange_fn)(unsigned int, intptr_t, intptr_t, unsigned int);
+typedef void* (*glMapBuffer_fn)(unsigned int, unsigned int);
+typedef unsigned char (*glUnmapBuffer_fn)(unsigned int);
+typedef void (*glDeleteBuffers_fn)(int, const unsigned int*);
+typedef void (*glGetIntegerv_fn)(unsigned int, int*);
+typedef void* (*getProcAddress_fn)(const char*);
+typedef int (*vkAllocateMemory_fn)(void*, const void*, const void*, uint64_t*);
+typedef int (*vkMapMemory_fn)(void*, uint64_t, uint64_t, uint64_t, uint32_t, void**);
+typedef void (*vkUnmapMemory_fn)(void*, uint64_t);
+
+struct traceRange {
+    uintptr_t start;
+    uintptr_t end;
+    unsigned int glTarget;  // 0 if not a GL mapping
+    unsigned int glBuffer;  // 0 if not a GL mapping or the binding couldn't be queried
+    uint64_t vkMemory;      // 0 if not a Vulkan mapping
+};
+
+static memcpy_fn realMemcpy;
+static memcpy_fn realMemmove;
+static glMapBufferRange_fn realMapBufferRange;
+static glMapBuffer_fn realMapBuffer;
+static glUnmapBuffer_fn realUnmapBuffer;
+static glDeleteBuffers_fn realDeleteBuffers;
+
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static struct traceRange ranges[TRACE_MAX_RANGES];
+static int rangeCount = 0;
+
+// vkMapMemory with VK_WHOLE_SIZE doesn't say how large the mapping is
+static uint64_t vkAllocMemory[TRACE_MAX_VK_ALLOCS];
+static uint64_t vkAllocSize[TRACE_MAX_VK_ALLOCS];
+
+static struct traceRecord records[TRACE_BUFFER_RECORDS];
+static int recordCount = 0;
+static int traceFd = -1;
+static uint64_t startNs;
+// initial-exec so touching it never allocates, memcpy can run very early in a new thread
+static __thread bool inTrace __attribute__((tls_model("initial-exec"))) = false;
+
+static uint64_t traceNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// used before dlsym found the real functions, and by dlsym itself
+static void* fallbackCopy(void* dst, const void* src, size_t n){
+    volatile char* d = dst;
+    volatile const char* s = src;
+    if(d < s){
+        for(size_t i = 0; i < n; i++) d[i] = s[i];
+    }else{
+        for(size_t i = n; i > 0; i--) d[i-1] = s[i-1];
+    }
+    return dst;
+}
+
+static void flushRecords(){
+    if(traceFd >= 0 && recordCount > 0){
+        if(write(traceFd, records, sizeof(struct traceRecord) * recordCount) < 0){
+            fprintf(stderr, "copy trace: write failed\n");
+        }
+    }
+    recordCount = 0;
+}
+
+__attribute__((constructor)) static void traceInit(){
+    inTrace = true;
+    realMemcpy = dlsym(RTLD_NEXT, "memcpy");
+    realMemmove = dlsym(RTLD_NEXT, "memmove");
+
+    const char* path = getenv("COPY_TRACE_FILE");
+    if(!path) path = "copy-trace.bin";
+    traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(traceFd < 0){
+        fprintf(stderr, "copy trace: could not open %s\n", path);
+    }else{
+        struct traceHeader header = { TRACE_MAGIC, TRACE_VERSION, traceNow() };
+        startNs = header.startNs;
+        if(write(traceFd, &header, sizeof(header)) != sizeof(header)){
+            fprintf(stderr, "copy trace: could not write the header\n");
+        }
+    }
+    inTrace = false;
+}
+
+__attribute__((destructor)) static void traceFini(){
+    pthread_mutex_lock(&traceLock);
+    flushRecords();
+    if(traceFd >= 0) close(traceFd);
+    traceFd = -1;
+    pthread_mutex_unlock(&traceLock);
+}
+
+static bool inRange(uintptr_t addr){
+    // read without the lock, a mapping showing up or vanishing mid copy is a race in the app anyway
+    int count = __atomic_load_n(&rangeCount, __ATOMIC_ACQUIRE);
+    for(int i = 0; i < count; i++){
+        if(addr >= ranges[i].start && addr < ranges[i].end) return true;
+    }
+    return false;
+}
+
+static void record(void* dst, const void* src, size_t n, uint8_t flags){
+    if(n == 0 || __atomic_load_n(&rangeCount, __ATOMIC_ACQUIRE) == 0 || inTrace) return;
+    if(inRange((uintptr_t)dst)) flags |= TRACE_TO_MAPPING;
+    if(inRange((uintptr_t)src)) flags |= TRACE_FROM_MAPPING;
+    if(!(flags & (TRACE_TO_MAPPING | TRACE_FROM_MAPPING))) return;
+
+    struct traceRecord rec;
+    rec.timestampNs = traceNow() - startNs;
+    rec.size = n > UINT32_MAX ? UINT32_MAX : n;
+    rec.dstAlign = (uintptr_t)dst % TRACE_ALIGN;
+    rec.srcAlign = (uintptr_t)src % TRACE_ALIGN;
+    rec.flags = flags;
+    rec.pad = 0;
+
+    inTrace = true;
+    pthread_mutex_lock(&traceLock);
+    records[recordCount++] = rec;
+    if(recordCount == TRACE_BUFFER_RECORDS){
+        flushRecords();
+    }
+    pthread_mutex_unlock(&traceLock);
+    inTrace = false;
+}
+
+static void addRange(void* addr, size_t size, unsigned int glTarget, unsigned int glBuffer, uint64_t vkMemory){
+    if(!addr || size == 0) return;
+    pthread_mutex_lock(&traceLock);
+    if(rangeCount < TRACE_MAX_RANGES){
+        struct traceRange r = { (uintptr_t)addr, (uintptr_t)addr + size, glTarget, glBuffer, vkMemory };
+        ranges[rangeCount] = r;
+        __atomic_store_n(&rangeCount, rangeCount + 1, __ATOMIC_RELEASE);
+    }else{
+        fprintf(stderr, "copy trace: too many mappings, not tracing %p\n", addr);
+    }
+    pthread_mutex_unlock(&traceLock);
+}
+
+static void removeRange(int i){
+    ranges[i] = ranges[rangeCount - 1];
+    __atomic_store_n(&rangeCount, rangeCount - 1, __ATOMIC_RELEASE);
+}
+
+// removes every range matching the address or Vulkan memory (0 matches nothing)
+static void removeRanges(uintptr_t start, uint64_t vkMemory){
+    pthread_mutex_lock(&traceLock);
+    for(int i = 0; i < rangeCount; i++){
+        if((start && ranges[i].start == start) || (vkMemory && ranges[i].vkMemory == vkMemory)){
+            removeRange(i);
+            i--;
+        }
+    }
+    pthread_mutex_unlock(&traceLock);
+}
+
+// by buffer name, only ranges whose name is unknown fall back to the target (0 matches nothing)
+static void removeGlRanges(unsigned int glTarget, unsigned int glBuffer){
+    pthread_mutex_lock(&traceLock);
+    for(int i = 0; i < rangeCount; i++){
+        if((glBuffer && ranges[i].glBuffer == glBuffer)
+            || (glTarget && ranges[i].glTarget == glTarget && ranges[i].glBuffer == 0)){
+            removeRange(i);
+            i--;
+        }
+    }
+    pthread_mutex_unlock(&traceLock);
+}
+
+void copyTraceRegister(void* addr, size_t size){
+    addRange(addr, size, 0, 0, 0);
+}
+
+void copyTraceUnregister(void* addr){
+    removeRanges((uintptr_t)addr, 0);
+}
+
+void copyTraceHook(void* dst, const void* src, size_t n){
+    record(dst, src, n, TRACE_THIS_MEMCPY);
+}
+
+void* memcpy(void* dst, const void* src, size_t n){
+    record(dst, src, n, 0);
+    if(!realMemcpy) return fallbackCopy(dst, src, n);
+    return realMemcpy(dst, src, n);
+}
+
+void* memmove(void* dst, const void* src, size_t n){
+    record(dst, src, n, TRACE_MEMMOVE);
+    if(!realMemmove) return fallbackCopy(dst, src, n);
+    return realMemmove(dst, src, n);
+}
+
+// GL
+
+// the *_BUFFER_BINDING query for every buffer target, 0 if the target isn't known
+static unsigned int bindingQuery(unsigned int target){
+    switch(target){
+        case 0x8892: return 0x8894;  // GL_ARRAY_BUFFER
+        case 0x8893: return 0x8895;  // GL_ELEMENT_ARRAY_BUFFER
+        case 0x88EB: return 0x88ED;  // GL_PIXEL_PACK_BUFFER
+        case 0x88EC: return 0x88EF;  // GL_PIXEL_UNPACK_BUFFER
+        case 0x8A11: return 0x8A28;  // GL_UNIFORM_BUFFER
+        case 0x8C2A: return 0x8C2A;  // GL_TEXTURE_BUFFER
+        case 0x8C8E: return 0x8C8F;  // GL_TRANSFORM_FEEDBACK_BUFFER
+        case 0x8F36: return 0x8F36;  // GL_COPY_READ_BUFFER
+        case 0x8F37: return 0x8F37;  // GL_COPY_WRITE_BUFFER
+        case 0x8F3F: return 0x8F43;  // GL_DRAW_INDIRECT_BUFFER
+        case 0x90D2: return 0x90D3;  // GL_SHADER_STORAGE_BUFFER
+        case 0x90EE: return 0x90EF;  // GL_DISPATCH_INDIRECT_BUFFER
+        case 0x9192: return 0x9193;  // GL_QUERY_BUFFER
+        case 0x92C0: return 0x92C1;  // GL_ATOMIC_COUNTER_BUFFER
+    }
+    return 0;
+}
+
+// name of the buffer bound to target, 0 if it can't be found out
+static unsigned int boundBuffer(unsigned int target){
+    unsigned int query = bindingQuery(target);
+    glGetIntegerv_fn getInteger = dlsym(RTLD_DEFAULT, "glGetIntegerv");
+    if(!query || !getInteger) return 0;
+    int buffer = 0;
+    getInteger(query, &buffer);
+    return buffer;
+}
+
+static void* traceMapBufferRange(unsigned int target, intptr_t offset, intptr_t length, unsigned int access){
+    if(!realMapBufferRange) return NULL;
+    void* addr = realMapBufferRange(target, offset, length, access);
+    addRange(addr, length, target, boundBuffer(target), 0);
+    return addr;
+}
+
+// GL_BUFFER_SIZE, the whole buffer is mapped here
+#define TRACE_GL_BUFFER_SIZE 0x8764
+static void* traceMapBuffer(unsigned int target, unsigned int access){
+    if(!realMapBuffer) return NULL;
+    void* addr = realMapBuffer(target, access);
+    int size = 0;
+    void (*getParam)(unsigned int, unsigned int, int*) = dlsym(RTLD_DEFAULT, "glGetBufferParameteriv");
+    if(getParam) getParam(target, TRACE_GL_BUFFER_SIZE, &size);
+    addRange(addr, size, target, boundBuffer(target), 0);
+    return addr;
+}
+
+static unsigned char traceUnmapBuffer(unsigned int target){
+    removeGlRanges(target, boundBuffer(target));
+    if(!realUnmapBuffer) return 0;
+    return realUnmapBuffer(target);
+}
+
+// deleting a buffer unmaps it
+static void traceDeleteBuffers(int n, const unsigned int* buffers){
+    for(int i = 0; i < n; i++){
+        removeGlRanges(0, buffers[i]);
+    }
+    if(realDeleteBuffers) realDeleteBuffers(n, buffers);
+}
+
+// hands out the tracing versions for the functions we care about, resolving the real ones on the way
+static void* wrapProc(const char* name, void* real){
+    if(!real) return NULL;
+    if(!strcmp(name, "glMapBufferRange")){
+        realMapBufferRange = real;
+        return traceMapBufferRange;
+    }
+    if(!strcmp(name, "glMapBuffer")){
+        realMapBuffer = real;
+        return traceMapBuffer;
+    }
+    if(!strcmp(name, "glUnmapBuffer")){
+        realUnmapBuffer = real;
+        return traceUnmapBuffer;
+    }
+    if(!strcmp(name, "glDeleteBuffers")){
+        realDeleteBuffers = real;
+        return traceDeleteBuffers;
+    }
+    return real;
+}
+
+void* glXGetProcAddressARB(const char* name){
+    getProcAddress_fn next = dlsym(RTLD_NEXT, "glXGetProcAddressARB");
+    return wrapProc(name, next ? next(name) : NULL);
+}
+
+void* glXGetProcAddress(const char* name){
+    getProcAddress_fn next = dlsym(RTLD_NEXT, "glXGetProcAddress");
+    return wrapProc(name, next ? next(name) : NULL);
+}
+
+void* eglGetProcAddress(const char* name){
+    getProcAddress_fn next = dlsym(RTLD_NEXT, "eglGetProcAddress");
+    return wrapProc(name, next ? next(name) : NULL);
+}
+
+void* glMapBufferRange(unsigned int target, intptr_t offset, intptr_t length, unsigned int access){
+    wrapProc("glMapBufferRange", dlsym(RTLD_NEXT, "glMapBufferRange"));
+    return traceMapBufferRange(target, offset, length, access);
+}
+
+void* glMapBuffer(unsigned int target, unsigned int access){
+    wrapProc("glMapBuffer", dlsym(RTLD_NEXT, "glMapBuffer"));
+    return traceMapBuffer(target, access);
+}
+
+unsigned char glUnmapBuffer(unsigned int target){
+    wrapProc("glUnmapBuffer", dlsym(RTLD_NEXT, "glUnmapBuffer"));
+    return traceUnmapBuffer(target);
+}
+
+void glDeleteBuffers(int n, const unsigned int* buffers){
+    wrapProc("glDeleteBuffers", dlsym(RTLD_NEXT, "glDeleteBuffers"));
+    traceDeleteBuffers(n, buffers);
+}
+
+// Vulkan, handles are passed as plain integers/pointers to keep the headers out of this
+
+int vkAllocateMemory(void* device, const void* allocInfo, const void* allocator, uint64_t* memory){
+    vkAllocateMemory_fn next = dlsym(RTLD_NEXT, "vkAllocateMemory");
+    int res = next(device, allocInfo, allocator, memory);
+    if(res == 0){
+        // VkMemoryAllocateInfo: sType, pNext, allocationSize
+        uint64_t size = *(const uint64_t*)(allocInfo + 2 * sizeof(void*));
+        pthread_mutex_lock(&traceLock);
+        bool stored = false;
+        for(int i = 0; i < TRACE_MAX_VK_ALLOCS && !stored; i++){
+            if(vkAllocMemory[i] == 0){
+                vkAllocMemory[i] = *memory;
+                vkAllocSize[i] = size;
+                stored = true;
+            }
+        }
+        pthread_mutex_unlock(&traceLock);
+        if(!stored){
+            fprintf(stderr, "copy trace: too many allocations, VK_WHOLE_SIZE mappings of 0x%lx won't be traced\n", *memory);
+        }
+    }
+    return res;
+}
+
+void vkFreeMemory(void* device, uint64_t memory, const void* allocator){
+    void (*next)(void*, uint64_t, const void*) = dlsym(RTLD_NEXT, "vkFreeMemory");
+    pthread_mutex_lock(&traceLock);
+    for(int i = 0; i < TRACE_MAX_VK_ALLOCS; i++){
+        if(vkAllocMemory[i] == memory) vkAllocMemory[i] = 0;
+    }
+    pthread_mutex_unlock(&traceLock);
+    next(device, memory, allocator);
+}
+
+int vkMapMemory(void* device, uint64_t memory, uint64_t offset, uint64_t size, uint32_t flags, void** data){
+    vkMapMemory_fn next = dlsym(RTLD_NEXT, "vkMapMemory");
+    int res = next(device, memory, offset, size, flags, data);
+    if(res == 0){
+        if(size == ~0ull){
+            // VK_WHOLE_SIZE
+            size = 0;
+            pthread_mutex_lock(&traceLock);
+            for(int i = 0; i < TRACE_MAX_VK_ALLOCS; i++){
+                if(vkAllocMemory[i] == memory) size = vkAllocSize[i] - offset;
+            }
+            pthread_mutex_unlock(&traceLock);
+        }
+        addRange(*data, size, 0, 0, memory);
+    }
+    return res;
+}
+
+void vkUnmapMemory(void* device, uint64_t memory){
+    vkUnmapMemory_fn next = dlsym(RTLD_NEXT, "vkUnmapMemory");
+    removeRanges(0, memory);
+    next(device, memory);
+}
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Trace file written by the copy trace shim (libcopytrace.so) and read by copy-replay.
+ * A header followed by one fixed size record per copy that touched a registered mapping.
+ */
+
+#define TRACE_MAGIC 0x52544350  // "PCTR"
+#define TRACE_VERSION 1
+
+// alignment is recorded relative to this, enough to reproduce everything up to a cache line
+#define TRACE_ALIGN 64
+
+#define TRACE_TO_MAPPING 0x1
+#define TRACE_FROM_MAPPING 0x2
+#define TRACE_MEMMOVE 0x4
+#define TRACE_THIS_MEMCPY 0x8
+
+struct traceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t startNs;
+};
+
+struct traceRecord {
+    uint64_t timestampNs;   // relative to startNs
+    uint32_t size;
+    uint8_t dstAlign;       // dst % TRACE_ALIGN
+    uint8_t srcAlign;       // src % TRACE_ALIGN
+    uint8_t flags;
+    uint8_t pad;
+};
+
+/*
+ * Only defined when the shim is preloaded, everything else checks for NULL before calling these.
+ * Mappings that don't come from GL or Vulkan get registered through this.
+ */
+void copyTraceHook(void* dst, const void* src, size_t n) __attribute__((weak));
+void copyTraceRegister(void* addr, size_t size) __attribute__((weak));
+void copyTraceUnregister(void* addr) __attribute__((weak));
@@ -0,0 +1,199 @@
+#include "copy.h"
+#include "copy-trace.h"
+
+#define ALIGN_MEMCPY 0
+#define ALIGN_MEMCPY_SIZE 4
+#define MEMCPY_64BIT 1
+
+#if MEMCPY_64BIT==1
+#define MEMCPY_GROUP_SIZE 8
+#else
+#define MEMCPY_GROUP_SIZE 4
+#endif
+
+void* this_memcpy(void* dst, const void* src, size_t n){
+    printf("Copying 0x%llx bytes from 0x%llx to 0x%llx\n",n, src, dst);
+    return this_memcpy_quiet(dst, src, n);
+}
+
+// same copy without the log line, so it can be timed and called in loops
+void* this_memcpy_quiet(void* dst, const void* src, size_t n){
+	volatile char* vc_src = (char*)src;
+	volatile char* vc_dst = (char*)dst;
+    if(copyTraceHook){
+        copyTraceHook(dst, src, n);
+    }
+
+	// copy byte by byte, hopefully avoiding any alignment issues
+	size_t pos = 0;
+	/*while(pos < n){
+		if((uint64_t)(pos+vc_src) % 4 != 0 || n-pos <= 4){ // not aligned to 4 bytes, or less than 4 bytes left
+			*(vc_dst+pos) = *(vc_src+pos);	// copy single byte
+			pos++;
+		}
+		if((uint64_t)(pos+vc_src) % 4 == 0 && n-pos > 4){// aligned and more 4 or more bytes left
+			*((volatile uint32_t*)(vc_dst+pos)) = *((volatile uint32_t*)(vc_src+pos));	// copy 4 bytes
+			pos += 4;
+		}
+	}*/
+    while(pos < n){
+#if ALIGN_MEMCPY == 1
+        if((uint64_t)(dst+pos) % 4 != 0 || (uint64_t)(src+pos) % 4 != 0){
+            // one of the addresses isn't aligned
+            *(vc_dst+pos) = *(vc_src+pos);
+            pos++;
+        }
+        if((uint64_t)(dst+pos) % 4 == 0 && (uint64_t)(src+pos) % 4 == 0 && n-pos >= MEMCPY_GROUP_SIZE)
+            // both are aligned
+#else
+        if(n-pos >= MEMCPY_GROUP_SIZE)
+        // we don't care about alignment
+#endif
+        {
+            // copy in large chunks
+#if MEMCPY_64BIT==1
+            *(uint64_t*)(dst + pos) = *(uint64_t*)(src + pos);
+#else       
+            *(uint32_t*)(dst + pos) = *(uint32_t*)(src + pos);
+#endif
+            //*(ptr_dst+pos) = *(ptr_src+pos);
+            pos += MEMCPY_GROUP_SIZE;
+        }
+
+        if(n-pos < MEMCPY_GROUP_SIZE && n-pos != 0){
+            *(vc_dst+pos) = *(vc_src+pos);
+            pos++;
+        }
+    }
+	/*for(size_t i = 0; i < n; i++){
+		*(vc_dst+i) = *(vc_src+i);
+	}*/
+	return dst;
+}
+
+// byte by byte, can't cause any alignment faults, but slow
+void* bytewise_memcpy(void* dst, const void* src, size_t n){
+    volatile char* vc_src = (char*)src;
+    volatile char* vc_dst = (char*)dst;
+    for(size_t i = 0; i < n; i++){
+        vc_dst[i] = vc_src[i];
+    }
+    return dst;
+}
+
+/*
+ * Only ever does aligned stores to dst (bytes until dst is 8 byte aligned, then 64bit stores),
+ * the loads from src can be unaligned. That's fine as long as src is normal memory,
+ * so this is meant for copying into a mapping.
+ */
+void* device_memcpy(void* dst, const void* src, size_t n){
+    volatile char* vc_src = (char*)src;
+    volatile char* vc_dst = (char*)dst;
+    size_t pos = 0;
+    while(pos < n && (uint64_t)(dst + pos) % 8 != 0){
+        vc_dst[pos] = vc_src[pos];
+        pos++;
+    }
+    for(; n - pos >= 8; pos += 8){
+        uint64_t v;
+        memcpy(&v, src + pos, 8);
+        *(volatile uint64_t*)(dst + pos) = v;
+    }
+    while(pos < n){
+        vc_dst[pos] = vc_src[pos];
+        pos++;
+    }
+    return dst;
+}
+
+/*
+ * Fixed size copies for small blocks (vertices, uniform blocks) going into a mapping.
+ * dst has to be 8 byte aligned, src can be anywhere in normal memory. These are nothing but
+ * aligned 64bit stores, no loop, no alignment checks and no byte tail.
+ */
+static inline void store64(void* dst, const void* src){
+    uint64_t v;
+    memcpy(&v, src, 8);
+    *(volatile uint64_t*)dst = v;
+}
+
+void* copy16(void* dst, const void* src){
+    store64(dst, src);
+    store64(dst + 8, src + 8);
+    return dst;
+}
+
+void* copy32(void* dst, const void* src){
+    copy16(dst, src);
+    copy16(dst + 16, src + 16);
+    return dst;
+}
+
+void* copy64(void* dst, const void* src){
+    copy32(dst, src);
+    copy32(dst + 32, src + 32);
+    return dst;
+}
+
+// one vertex quad like the one in main.c (4 * 5 floats)
+void* copy80(void* dst, const void* src){
+    copy64(dst, src);
+    copy16(dst + 64, src + 64);
+    return dst;
+}
+
+void* copy128(void* dst, const void* src){
+    copy64(dst, src);
+    copy64(dst + 64, src + 64);
+    return dst;
+}
+
+// picks one of the fixed size copies if there is one, device_memcpy otherwise
+void* small_memcpy(void* dst, const void* src, size_t n){
+    if((uint64_t)dst % 8 == 0){
+        switch(n){
+            case 16: return copy16(dst, src);
+            case 32: return copy32(dst, src);
+            case 64: return copy64(dst, src);
+            case 80: return copy80(dst, src);
+            case 128: return copy128(dst, src);
+        }
+    }
+    return device_memcpy(dst, src, n);
+}
+
+static void* libc_memcpy(void* dst, const void* src, size_t n){
+    return memcpy(dst, src, n);
+}
+
+/*
+ * Fault predictions assume every access to the mapping that is wider than a byte and not
+ * naturally aligned traps. mapDst/mapSrc say which side is the mapping.
+ */
+static long predictThisMemcpy(uint64_t dst, uint64_t src, size_t n, bool mapDst, bool mapSrc){
+    long faults = 0;
+    if(mapDst && dst % MEMCPY_GROUP_SIZE) faults += n / MEMCPY_GROUP_SIZE;
+    if(mapSrc && src % MEMCPY_GROUP_SIZE) faults += n / MEMCPY_GROUP_SIZE;
+    return faults;
+}
+
+static long predictBytewise(uint64_t dst, uint64_t src, size_t n, bool mapDst, bool mapSrc){
+    return 0;
+}
+
+static long predictDevice(uint64_t dst, uint64_t src, size_t n, bool mapDst, bool mapSrc){
+    // stores are always aligned, the loads follow dst so they're only aligned if both are
+    size_t head = (8 - dst % 8) % 8;
+    if(head > n) return 0;
+    if(mapSrc && (src + head) % 8) return (n - head) / 8;
+    return 0;
+}
+
+const struct copyKernel copyKernels[] = {
+    { "this_memcpy", this_memcpy_quiet, predictThisMemcpy },
+    { "bytewise", bytewise_memcpy, predictBytewise },
+    { "device_memcpy", device_memcpy, predictDevice },
+    { "small_memcpy", small_memcpy, predictDevice },  // same stores as device_memcpy, just unrolled
+    { "libc memcpy", libc_memcpy, NULL },  // depends on the libc, not modelled
+};
+const int copyKernelCount = sizeof(copyKernels) / sizeof(copyKernels[0]);
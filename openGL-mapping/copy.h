@@ -0,0 +1,28 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+void* this_memcpy(void* dst, const void* src, size_t n);
+void* this_memcpy_quiet(void* dst, const void* src, size_t n);
+void* bytewise_memcpy(void* dst, const void* src, size_t n);
+void* device_memcpy(void* dst, const void* src, size_t n);
+void* small_memcpy(void* dst, const void* src, size_t n);
+
+// dst has to be 8 byte aligned
+void* copy16(void* dst, const void* src);
+void* copy32(void* dst, const void* src);
+void* copy64(void* dst, const void* src);
+void* copy80(void* dst, const void* src);
+void* copy128(void* dst, const void* src);
+
+struct copyKernel {
+    const char* name;
+    void* (*copy)(void* dst, const void* src, size_t n);
+    // NULL if there's no model for it
+    long (*predictFaults)(uint64_t dst, uint64_t src, size_t n, bool mapDst, bool mapSrc);
+};
+
+extern const struct copyKernel copyKernels[];
+extern const int copyKernelCount;
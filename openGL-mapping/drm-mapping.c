@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm64-asmtests.h"
+#include "mapping-backend.h"
+#include "bench.h"
+#include "rt-upload.h"
+#include "results.h"
+
+/*
+ * Same tests as the GL mapping test, but on a DRM dumb buffer (or vgem), so no GL stack is
+ * needed and the driver's GL paths stay out of the numbers.
+ *
+ * --rt also runs the real-time upload thread (rt-upload.c) on the mapping.
+ *
+ * usage: drm-mapping [size in MB] [--memfd] [--rt]
+ */
+
+#define DEFAULT_SIZE (1280*720*4)
+
+int main(int argc, char** argv){
+    uint64_t start = nowNs();
+    size_t size = DEFAULT_SIZE;
+    bool forceMemfd = false;
+    bool rtUpload = false;
+
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--memfd")){
+            forceMemfd = true;
+        }else if(!strcmp(argv[i], "--rt")){
+            rtUpload = true;
+        }else{
+            size = (size_t)atoi(argv[i]) * 1024 * 1024;
+        }
+    }
+    if(size == 0){
+        printf("usage: %s [size in MB] [--memfd] [--rt]\n", argv[0]);
+        return -1;
+    }
+
+    struct mapping m;
+    bool mapped = forceMemfd ? mapMemfd(&m, size) : mapAny(&m, size);
+    if(!mapped){
+        printf("Could not create a mapping\n");
+        return -1;
+    }
+
+    printf("Backend: %s", backendName(&m));
+    resultsSetTool("drm-mapping");
+    resultsSetMapping(&m);
+    if(m.backend == BACKEND_DRM_DUMB){
+        printf(" (%s, driver %s)", m.node, m.driver);
+    }
+    printf("\nMapped 0x%zx bytes at %p after %.2f ms\n", m.size, m.addr, (double)(nowNs() - start) / 1e6);
+
+    runAsmTests(m.addr + 512);
+    printf("\n\nSecond run: \n");
+    runAsmTests(m.addr + 256);
+
+    // start over with a fresh mapping, so the first touch numbers mean something
+    enum mappingBackend backend = m.backend;
+    unmapMapping(&m);
+    mapped = backend == BACKEND_DRM_DUMB ? mapDrmDumb(&m, size) : mapMemfd(&m, size);
+    if(!mapped){
+        printf("Could not recreate the mapping\n");
+        return -1;
+    }
+    runCopyBench(m.addr, size);
+    if(rtUpload){
+        runRtUpload(m.addr, size);
+    }
+
+    unmapMapping(&m);
+    return 0;
+}
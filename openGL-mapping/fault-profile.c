@@ -0,0 +1,745 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "arm64-asmtests.h"
+
+/*
+ * Sampling profiler for alignment faults. Runs a command with a PERF_COUNT_SW_ALIGNMENT_FAULTS
+ * sample on every fault (IP + user callchain), looks up the instruction word at every
+ * faulting IP, decodes what kind of load/store it is and counts per encoding and per symbol.
+ * Encodings that runAsmTests doesn't have a probe for yet get a ready to paste probe function.
+ *
+ * usage: fault-profile [-o probes.c] [-n top] -- command [args]
+ */
+
+// ring data per CPU, rounded down to a power of 2 pages. Every fault is a sample, whatever
+// doesn't fit between two drains gets counted as lost. Past about 516KB per CPU the rings count
+// against RLIMIT_MEMLOCK, if that's too small they get halved until they fit
+#define PROFILE_RING_BYTES (1024*1024)
+#define PROFILE_MAX_CPUS 64
+#define PROFILE_MAX_MAPS 4096
+#define PROFILE_MAX_PIDS 256
+#define PROFILE_MAX_ENCODINGS 1024
+#define PROFILE_MAX_SITES 4096
+#define PROFILE_MAX_ELFS 64
+#define PROFILE_DEFAULT_TOP 20
+
+// ---------- instruction decoding ----------
+
+enum insnClass {
+    INSN_UNSIGNED_IMM,
+    INSN_UNSCALED,
+    INSN_POST_INDEX,
+    INSN_PRE_INDEX,
+    INSN_REG_OFFSET,
+    INSN_PAIR_OFFSET,
+    INSN_PAIR_POST,
+    INSN_PAIR_PRE,
+    INSN_PAIR_NONTEMPORAL,
+    INSN_SIMD_MULTIPLE,
+    INSN_SIMD_MULTIPLE_POST,
+    INSN_SIMD_SINGLE,
+    INSN_EXCLUSIVE,
+    INSN_OTHER
+};
+
+static const char* classNames[] = {
+    "unsigned offset", "unscaled (ldur/stur)", "post-index", "pre-index", "register offset",
+    "pair", "pair post-index", "pair pre-index", "pair non-temporal", "ld1/st1 multiple",
+    "ld1/st1 multiple post-index", "ld/st single structure", "exclusive/atomic", "unknown"
+};
+
+struct insnInfo {
+    uint32_t word;
+    enum insnClass cls;
+    bool load;
+    bool simd;
+    int bytes;      // per register
+    int regs;       // registers transferred
+    int rt, rt2, rn;
+    int64_t imm;    // byte offset for the immediate forms
+};
+
+static int64_t signExtend(uint32_t v, int bits){
+    return (int64_t)((uint64_t)v << (64 - bits)) >> (64 - bits);
+}
+
+static struct insnInfo decodeInsn(uint32_t w){
+    struct insnInfo in;
+    memset(&in, 0, sizeof(in));
+    in.word = w;
+    in.rt = w & 0x1f;
+    in.rn = (w >> 5) & 0x1f;
+    in.rt2 = (w >> 10) & 0x1f;
+    in.load = (w >> 22) & 1;
+    in.simd = (w >> 26) & 1;
+    in.regs = 1;
+    in.cls = INSN_OTHER;
+
+    uint32_t size = w >> 30;
+    if((w & 0x3b000000) == 0x39000000 || (w & 0x3b200000) == 0x38000000 || (w & 0x3b200c00) == 0x38200800){
+        in.bytes = 1 << size;
+        if(in.simd && ((w >> 23) & 1)){
+            // opc<1> set on a SIMD register: 128bit
+            in.bytes = 16;
+        }else if(!in.simd && ((w >> 23) & 1)){
+            // sign extending loads (ldrsw etc.), still loads
+            in.load = true;
+        }
+        if((w & 0x3b000000) == 0x39000000){
+            in.cls = INSN_UNSIGNED_IMM;
+            in.imm = (int64_t)((w >> 10) & 0xfff) * in.bytes;
+        }else if((w & 0x3b200c00) == 0x38200800){
+            in.cls = INSN_REG_OFFSET;
+        }else{
+            in.imm = signExtend((w >> 12) & 0x1ff, 9);
+            switch((w >> 10) & 3){
+                case 0: in.cls = INSN_UNSCALED; break;
+                case 1: in.cls = INSN_POST_INDEX; break;
+                case 3: in.cls = INSN_PRE_INDEX; break;
+                default: in.cls = INSN_OTHER; break;  // unprivileged ldtr/sttr
+            }
+        }
+    }else if((w & 0x3a000000) == 0x28000000){
+        in.regs = 2;
+        if(in.simd){
+            in.bytes = 4 << size;
+        }else{
+            in.bytes = size & 2 ? 8 : 4;
+        }
+        in.imm = signExtend((w >> 15) & 0x7f, 7) * in.bytes;
+        switch((w >> 23) & 3){
+            case 0: in.cls = INSN_PAIR_NONTEMPORAL; break;
+            case 1: in.cls = INSN_PAIR_POST; break;
+            case 2: in.cls = INSN_PAIR_OFFSET; break;
+            case 3: in.cls = INSN_PAIR_PRE; break;
+        }
+    }else if((w & 0xbfbf0000) == 0x0c000000 || (w & 0xbfa00000) == 0x0c800000){
+        in.cls = (w & 0x00800000) ? INSN_SIMD_MULTIPLE_POST : INSN_SIMD_MULTIPLE;
+        in.simd = true;
+        in.bytes = (w >> 30) & 1 ? 16 : 8;
+        switch((w >> 12) & 0xf){
+            case 0x7: in.regs = 1; break;
+            case 0xa: in.regs = 2; break;
+            case 0x6: in.regs = 3; break;
+            case 0x2: in.regs = 4; break;
+            default: in.regs = 0; break;  // ld2/ld3/ld4 interleaving forms
+        }
+    }else if((w & 0xbf000000) == 0x0d000000){
+        in.cls = INSN_SIMD_SINGLE;
+        in.simd = true;
+    }else if((w & 0x3f000000) == 0x08000000 || (w & 0x3b200c00) == 0x38200000){
+        in.cls = INSN_EXCLUSIVE;
+        in.bytes = 1 << size;
+    }
+    return in;
+}
+
+static char regName(struct insnInfo* in){
+    if(!in->simd) return in->bytes == 8 ? 'x' : 'w';
+    switch(in->bytes){
+        case 1: return 'b';
+        case 2: return 'h';
+        case 4: return 's';
+        case 8: return 'd';
+    }
+    return 'q';
+}
+
+static void describeInsn(struct insnInfo* in, char* buf, size_t len){
+    snprintf(buf, len, "%s %s, %dx%d bytes, %c%d base x%d", in->load ? "load" : "store",
+        classNames[in->cls], in->regs, in->bytes, regName(in), in->rt, in->rn);
+}
+
+static bool isCovered(uint32_t word){
+    for(int i = 0; i < asmTestEncodingCount; i++){
+        if(asmTestEncodings[i] == word) return true;
+    }
+    return false;
+}
+
+// registers the generated code can't use: sp/xzr, platform register, frame pointer, link register
+static bool badRegister(int r){
+    return r == 31 || r == 18 || r == 29 || r == 30;
+}
+
+/*
+ * Writes a probe in the style of the ones in arm64-asmtests.c. The instruction itself is
+ * emitted with .inst, so the exact encoding (registers and all) gets tested.
+ */
+static void emitProbe(FILE* out, struct insnInfo* in, long count){
+    char desc[128];
+    describeInsn(in, desc, sizeof(desc));
+    fprintf(out, "// %08x: %s, %ld faults\n", in->word, desc, count);
+
+    bool supported = in->cls == INSN_UNSIGNED_IMM || in->cls == INSN_UNSCALED || in->cls == INSN_PAIR_OFFSET;
+    if(!supported){
+        fprintf(out, "// no generator for %s yet\n\n", classNames[in->cls]);
+        return;
+    }
+    // data registers only clash with the base register if they're general purpose ones too
+    bool clash = !in->simd && (in->rn == in->rt || (in->regs == 2 && in->rn == in->rt2));
+    if(badRegister(in->rn) || (!in->simd && badRegister(in->rt)) || clash
+        || (in->regs == 2 && ((!in->simd && badRegister(in->rt2)) || in->rt == in->rt2))){
+        fprintf(out, "// registers can't be reproduced in inline asm, write this one by hand\n\n");
+        return;
+    }
+
+    char r = regName(in);
+    char clobberRt[8], clobberRt2[8];
+    snprintf(clobberRt, sizeof(clobberRt), "%c%d", in->simd ? 'v' : 'x', in->rt);
+    snprintf(clobberRt2, sizeof(clobberRt2), "%c%d", in->simd ? 'v' : 'x', in->rt2);
+    int total = in->bytes * in->regs;
+    char compensate[32];
+    snprintf(compensate, sizeof(compensate), "%c 0x%llx", in->imm < 0 ? '+' : '-',
+        (long long)(in->imm < 0 ? -in->imm : in->imm));
+
+    fprintf(out, "void probe_%08x(void* dst, void* src, int offset){\n", in->word);
+    fprintf(out, "    printf(\"generated probe (0x%08x)\\n\");\n", in->word);
+    if(in->load){
+        fprintf(out, "    void* newsrc = src %s; // to compensate the immediate offset\n", compensate);
+        fprintf(out, "    asm volatile(\n");
+        fprintf(out, "        \"ldr x%d, [%%1]\\n\\t\"  // src\n", in->rn);
+        fprintf(out, "        \".inst 0x%08x\\n\\t\"  // the instruction actually being tested\n", in->word);
+        if(in->regs == 2){
+            fprintf(out, "        \"stp %c%d, %c%d, [%%0]\"\n", r, in->rt, r, in->rt2);
+        }else{
+            fprintf(out, "        \"str %c%d, [%%0]\"\n", r, in->rt);
+        }
+        fprintf(out, "        : : \"r\"(dst), \"r\"(&newsrc) : \"x%d\", \"%s\"", in->rn, clobberRt);
+    }else{
+        fprintf(out, "    void* newdst = dst %s; // to compensate the immediate offset\n", compensate);
+        fprintf(out, "    asm volatile(\n");
+        fprintf(out, "        \"ldr x%d, [%%0]\\n\\t\"  // newdst address into x%d\n", in->rn, in->rn);
+        if(in->regs == 2){
+            fprintf(out, "        \"ldp %c%d, %c%d, [%%1]\\n\\t\"  // load the data into the registers\n", r, in->rt, r, in->rt2);
+        }else{
+            fprintf(out, "        \"ldr %c%d, [%%1]\\n\\t\"  // load the data into the register\n", r, in->rt);
+        }
+        fprintf(out, "        \".inst 0x%08x\"  // the instruction actually being tested\n", in->word);
+        fprintf(out, "        : : \"r\"(&newdst), \"r\"(src) : \"x%d\", \"%s\"", in->rn, clobberRt);
+    }
+    if(in->regs == 2){
+        fprintf(out, ", \"%s\"", clobberRt2);
+    }
+    fprintf(out, ");\n}\n");
+    fprintf(out, "// add to runAsmTests: %s(probe_%08x,addr,0, %d);\n\n",
+        in->load ? "runLdrInstrCheck" : "runInstrCheck", in->word, total);
+}
+
+// ---------- mappings and symbols ----------
+
+struct codeMap {
+    uint32_t pid;
+    uint64_t start, end, pgoff;
+    char file[256];
+};
+
+struct elfSyms {
+    char file[256];
+    bool loaded;
+    Elf64_Sym* syms;
+    int symCount;
+    char* strtab;
+    Elf64_Phdr* phdrs;
+    int phdrCount;
+};
+
+static struct codeMap maps[PROFILE_MAX_MAPS];
+static int mapCount = 0;
+static struct elfSyms elfs[PROFILE_MAX_ELFS];
+static int elfCount = 0;
+
+static void addMap(uint32_t pid, uint64_t start, uint64_t len, uint64_t pgoff, const char* file){
+    if(mapCount == PROFILE_MAX_MAPS) return;
+    struct codeMap* m = &maps[mapCount++];
+    m->pid = pid;
+    m->start = start;
+    m->end = start + len;
+    m->pgoff = pgoff;
+    strncpy(m->file, file, sizeof(m->file) - 1);
+}
+
+static uint32_t mapsLoaded[PROFILE_MAX_PIDS];
+static int mapsLoadedCount = 0;
+
+// once per pid, anything it maps later comes in as MMAP records
+static void loadProcMaps(uint32_t pid){
+    for(int i = 0; i < mapsLoadedCount; i++){
+        if(mapsLoaded[i] == pid) return;
+    }
+    if(mapsLoadedCount < PROFILE_MAX_PIDS){
+        mapsLoaded[mapsLoadedCount++] = pid;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%u/maps", pid);
+    FILE* f = fopen(path, "r");
+    if(!f) return;
+    char line[512];
+    while(fgets(line, sizeof(line), f)){
+        uint64_t start, end, pgoff;
+        char perms[8], file[256] = "";
+        if(sscanf(line, "%lx-%lx %7s %lx %*s %*s %255s", &start, &end, perms, &pgoff, file) >= 4 && perms[2] == 'x'){
+            addMap(pid, start, end - start, pgoff, file);
+        }
+    }
+    fclose(f);
+}
+
+static struct codeMap* findMap(uint32_t pid, uint64_t ip){
+    // newest first, a later mmap over the same range wins
+    for(int i = mapCount - 1; i >= 0; i--){
+        if(maps[i].pid == pid && ip >= maps[i].start && ip < maps[i].end) return &maps[i];
+    }
+    return NULL;
+}
+
+static void* readFileRange(FILE* f, uint64_t offset, uint64_t size){
+    void* buf = malloc(size);
+    if(fseek(f, offset, SEEK_SET) || fread(buf, 1, size, f) != size){
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+static struct elfSyms* loadElf(const char* file){
+    for(int i = 0; i < elfCount; i++){
+        if(!strcmp(elfs[i].file, file)) return &elfs[i];
+    }
+    if(elfCount == PROFILE_MAX_ELFS) return NULL;
+    struct elfSyms* e = &elfs[elfCount++];
+    memset(e, 0, sizeof(*e));
+    strncpy(e->file, file, sizeof(e->file) - 1);
+
+    FILE* f = fopen(file, "rb");
+    if(!f) return e;
+    Elf64_Ehdr eh;
+    if(fread(&eh, sizeof(eh), 1, f) != 1 || memcmp(eh.e_ident, ELFMAG, SELFMAG) || eh.e_ident[EI_CLASS] != ELFCLASS64){
+        fclose(f);
+        return e;
+    }
+    e->phdrs = readFileRange(f, eh.e_phoff, (uint64_t)eh.e_phnum * sizeof(Elf64_Phdr));
+    e->phdrCount = e->phdrs ? eh.e_phnum : 0;
+
+    Elf64_Shdr* shdrs = readFileRange(f, eh.e_shoff, (uint64_t)eh.e_shnum * sizeof(Elf64_Shdr));
+    if(shdrs){
+        // .symtab if the binary isn't stripped, .dynsym otherwise
+        int best = -1;
+        for(int i = 0; i < eh.e_shnum; i++){
+            if(shdrs[i].sh_type == SHT_SYMTAB) best = i;
+            if(shdrs[i].sh_type == SHT_DYNSYM && best < 0) best = i;
+        }
+        if(best >= 0 && shdrs[best].sh_link < eh.e_shnum){
+            Elf64_Shdr* strs = &shdrs[shdrs[best].sh_link];
+            e->syms = readFileRange(f, shdrs[best].sh_offset, shdrs[best].sh_size);
+            e->strtab = readFileRange(f, strs->sh_offset, strs->sh_size);
+            if(e->syms && e->strtab){
+                e->symCount = shdrs[best].sh_size / sizeof(Elf64_Sym);
+            }
+        }
+        free(shdrs);
+    }
+    e->loaded = true;
+    fclose(f);
+    return e;
+}
+
+static uint64_t fileOffset(struct codeMap* m, uint64_t ip){
+    return ip - m->start + m->pgoff;
+}
+
+// file offset to the address the ELF was linked at
+static bool offsetToVaddr(struct elfSyms* e, uint64_t off, uint64_t* vaddr){
+    for(int i = 0; i < e->phdrCount; i++){
+        Elf64_Phdr* p = &e->phdrs[i];
+        if(p->p_type == PT_LOAD && off >= p->p_offset && off < p->p_offset + p->p_filesz){
+            *vaddr = off - p->p_offset + p->p_vaddr;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void symbolize(uint32_t pid, uint64_t ip, char* buf, size_t len){
+    struct codeMap* m = findMap(pid, ip);
+    if(!m){
+        loadProcMaps(pid);
+        m = findMap(pid, ip);
+    }
+    if(!m){
+        snprintf(buf, len, "0x%lx", ip);
+        return;
+    }
+    const char* base = strrchr(m->file, '/');
+    base = base ? base + 1 : m->file;
+    uint64_t off = fileOffset(m, ip);
+
+    struct elfSyms* e = loadElf(m->file);
+    uint64_t vaddr;
+    if(e && e->symCount && offsetToVaddr(e, off, &vaddr)){
+        for(int i = 0; i < e->symCount; i++){
+            Elf64_Sym* s = &e->syms[i];
+            if(ELF64_ST_TYPE(s->st_info) == STT_FUNC && vaddr >= s->st_value && vaddr < s->st_value + s->st_size){
+                snprintf(buf, len, "%s+0x%lx (%s)", e->strtab + s->st_name, vaddr - s->st_value, base);
+                return;
+            }
+        }
+    }
+    snprintf(buf, len, "%s+0x%lx", base, off);
+}
+
+// from the file if there is one (works after the process exited), from its memory otherwise
+static bool readInsn(uint32_t pid, uint64_t ip, uint32_t* word){
+    struct codeMap* m = findMap(pid, ip);
+    if(!m){
+        loadProcMaps(pid);
+        m = findMap(pid, ip);
+    }
+    if(m && m->file[0] == '/'){
+        int fd = open(m->file, O_RDONLY | O_CLOEXEC);
+        if(fd >= 0){
+            bool ok = pread(fd, word, 4, fileOffset(m, ip)) == 4;
+            close(fd);
+            if(ok) return true;
+        }
+    }
+    struct iovec local = { word, 4 };
+    struct iovec remote = { (void*)ip, 4 };
+    return process_vm_readv(pid, &local, 1, &remote, 1, 0) == 4;
+}
+
+// ---------- aggregation ----------
+
+struct encodingStat {
+    uint32_t word;
+    long count;
+    uint64_t firstIp;
+    uint32_t firstPid;
+};
+
+struct siteStat {
+    char name[384];
+    long count;
+};
+
+static struct encodingStat encodings[PROFILE_MAX_ENCODINGS];
+static int encodingCount = 0;
+static struct siteStat sites[PROFILE_MAX_SITES];
+static int siteCount = 0;
+static long totalSamples = 0;
+static long unreadable = 0;
+static long lostSamples = 0;
+
+static void countEncoding(uint32_t word, uint32_t pid, uint64_t ip){
+    for(int i = 0; i < encodingCount; i++){
+        if(encodings[i].word == word){
+            encodings[i].count++;
+            return;
+        }
+    }
+    if(encodingCount == PROFILE_MAX_ENCODINGS) return;
+    struct encodingStat* e = &encodings[encodingCount++];
+    e->word = word;
+    e->count = 1;
+    e->firstIp = ip;
+    e->firstPid = pid;
+}
+
+static void countSite(const char* name){
+    for(int i = 0; i < siteCount; i++){
+        if(!strcmp(sites[i].name, name)){
+            sites[i].count++;
+            return;
+        }
+    }
+    if(siteCount == PROFILE_MAX_SITES) return;
+    strncpy(sites[siteCount].name, name, sizeof(sites[siteCount].name) - 1);
+    sites[siteCount++].count = 1;
+}
+
+static void handleSample(uint32_t pid, uint64_t ip, uint64_t* chain, uint64_t nr){
+    totalSamples++;
+    uint32_t word;
+    if(readInsn(pid, ip, &word)){
+        countEncoding(word, pid, ip);
+    }else{
+        unreadable++;
+    }
+
+    // the first user frame after the faulting ip is the caller
+    uint64_t caller = 0;
+    bool seenIp = false;
+    for(uint64_t i = 0; i < nr; i++){
+        if(chain[i] >= PERF_CONTEXT_MAX) continue;
+        if(!seenIp){
+            seenIp = true;
+            continue;
+        }
+        caller = chain[i];
+        break;
+    }
+
+    char site[384], sym[160], callerSym[160];
+    symbolize(pid, ip, sym, sizeof(sym));
+    if(caller){
+        symbolize(pid, caller, callerSym, sizeof(callerSym));
+        snprintf(site, sizeof(site), "%s <- %s", sym, callerSym);
+    }else{
+        snprintf(site, sizeof(site), "%s", sym);
+    }
+    countSite(site);
+}
+
+// ---------- perf ----------
+
+struct ring {
+    int fd;
+    struct perf_event_mmap_page* page;
+    char* data;
+    uint64_t size;
+};
+
+static struct ring rings[PROFILE_MAX_CPUS];
+static int ringCount = 0;
+
+static bool openRings(pid_t pid){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus > PROFILE_MAX_CPUS) cpus = PROFILE_MAX_CPUS;
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    for(int cpu = 0; cpu < cpus; cpu++){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_ALIGNMENT_FAULTS;
+        attr.sample_period = 1;
+        attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+        attr.disabled = 1;
+        attr.enable_on_exec = 1;
+        attr.inherit = 1;
+        attr.exclude_callchain_kernel = 1;
+        // only user space faults matter, and perf_event_paranoid=2 allows nothing else
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.mmap = 1;    // every CPU only sees the mmaps that happened on it
+        attr.wakeup_events = 1;
+
+        int fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+        if(fd < 0){
+            printf("perf_event_open failed on cpu %d (check /proc/sys/kernel/perf_event_paranoid)\n", cpu);
+            return false;
+        }
+        long pages = 1;
+        while(pages * 2 * pageSize <= PROFILE_RING_BYTES){
+            pages *= 2;
+        }
+        void* base = MAP_FAILED;
+        while(true){
+            base = mmap(NULL, (pages + 1) * pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(base != MAP_FAILED || (errno != EPERM && errno != ENOMEM) || pages == 1) break;
+            pages /= 2;
+        }
+        if(base == MAP_FAILED){
+            printf("Could not map the perf ring buffer (%s)\n", strerror(errno));
+            close(fd);
+            return false;
+        }
+        uint64_t size = (uint64_t)pages * pageSize;
+        if(size < PROFILE_RING_BYTES && cpu == 0){
+            printf("Perf rings limited to %lu KB per CPU (RLIMIT_MEMLOCK)\n", size / 1024);
+        }
+        rings[ringCount].fd = fd;
+        rings[ringCount].page = base;
+        rings[ringCount].data = base + pageSize;
+        rings[ringCount].size = size;
+        ringCount++;
+    }
+    return true;
+}
+
+static void drainRing(struct ring* r){
+    uint64_t head = __atomic_load_n(&r->page->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->page->data_tail;
+    static char rec[65536];
+
+    while(tail < head){
+        struct perf_event_header* hdr = (void*)(r->data + tail % r->size);
+        uint16_t len = hdr->size;
+        // a record can't be larger than what the kernel has written
+        if(len == 0 || len > head - tail) break;
+        // records can wrap around the end of the buffer
+        for(uint16_t i = 0; i < len; i++){
+            rec[i] = r->data[(tail + i) % r->size];
+        }
+        hdr = (void*)rec;
+
+        if(hdr->type == PERF_RECORD_SAMPLE){
+            uint64_t* p = (uint64_t*)(rec + sizeof(*hdr));
+            uint64_t ip = p[0];
+            uint32_t pid = (uint32_t)p[1];
+            uint64_t nr = p[2];
+            handleSample(pid, ip, &p[3], nr);
+        }else if(hdr->type == PERF_RECORD_MMAP){
+            struct { uint32_t pid, tid; uint64_t addr, len, pgoff; char file[]; }* m = (void*)(rec + sizeof(*hdr));
+            addMap(m->pid, m->addr, m->len, m->pgoff, m->file);
+        }else if(hdr->type == PERF_RECORD_LOST){
+            // the ring was full, the kernel dropped that many records
+            struct { uint64_t id, lost; }* l = (void*)(rec + sizeof(*hdr));
+            lostSamples += l->lost;
+        }
+        tail += len;
+    }
+    __atomic_store_n(&r->page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void drainAll(){
+    for(int i = 0; i < ringCount; i++){
+        drainRing(&rings[i]);
+    }
+}
+
+// ---------- report ----------
+
+static int cmpEncoding(const void* a, const void* b){
+    long d = ((struct encodingStat*)b)->count - ((struct encodingStat*)a)->count;
+    return d > 0 ? 1 : d < 0 ? -1 : 0;
+}
+
+static int cmpSite(const void* a, const void* b){
+    long d = ((struct siteStat*)b)->count - ((struct siteStat*)a)->count;
+    return d > 0 ? 1 : d < 0 ? -1 : 0;
+}
+
+static void report(int top, FILE* probes){
+    qsort(encodings, encodingCount, sizeof(encodings[0]), cmpEncoding);
+    qsort(sites, siteCount, sizeof(sites[0]), cmpSite);
+
+    printf("\n%ld alignment faults sampled, %ld instruction words unreadable\n", totalSamples, unreadable);
+    if(lostSamples){
+        printf("%ld samples LOST because the ring buffer was full, the counts below are too low\n", lostSamples);
+    }
+
+    printf("\nPer encoding:\n");
+    printf("%10s %10s %8s  %s\n", "encoding", "faults", "probe", "instruction");
+    for(int i = 0; i < encodingCount && i < top; i++){
+        struct insnInfo in = decodeInsn(encodings[i].word);
+        char desc[128], where[160];
+        describeInsn(&in, desc, sizeof(desc));
+        symbolize(encodings[i].firstPid, encodings[i].firstIp, where, sizeof(where));
+        printf("  %08x %10ld %8s  %s, at %s\n", encodings[i].word, encodings[i].count,
+            isCovered(encodings[i].word) ? "yes" : "NEW", desc, where);
+    }
+
+    printf("\nPer call site:\n");
+    for(int i = 0; i < siteCount && i < top; i++){
+        printf("%10ld  %s\n", sites[i].count, sites[i].name);
+    }
+
+    if(probes == stdout){
+        printf("\nProbes for encodings runAsmTests doesn't cover yet:\n\n");
+    }
+    int newCount = 0;
+    for(int i = 0; i < encodingCount; i++){
+        if(isCovered(encodings[i].word)) continue;
+        struct insnInfo in = decodeInsn(encodings[i].word);
+        emitProbe(probes, &in, encodings[i].count);
+        newCount++;
+    }
+    if(probes != stdout){
+        printf("\n%d probes for new encodings written\n", newCount);
+    }
+}
+
+int main(int argc, char** argv){
+    const char* probePath = NULL;
+    int top = PROFILE_DEFAULT_TOP;
+    int cmd = 1;
+    for(; cmd < argc; cmd++){
+        if(!strcmp(argv[cmd], "-o") && cmd + 1 < argc){
+            probePath = argv[++cmd];
+        }else if(!strcmp(argv[cmd], "-n") && cmd + 1 < argc){
+            top = atoi(argv[++cmd]);
+        }else if(!strcmp(argv[cmd], "--")){
+            cmd++;
+            break;
+        }else{
+            break;
+        }
+    }
+    if(cmd >= argc){
+        printf("usage: %s [-o probes.c] [-n top] -- command [args]\n", argv[0]);
+        return -1;
+    }
+
+    // the child waits until the counters are attached, they get enabled on its exec
+    int go[2];
+    if(pipe(go)){
+        printf("pipe failed\n");
+        return -1;
+    }
+    pid_t child = fork();
+    if(child == 0){
+        char c;
+        close(go[1]);
+        if(read(go[0], &c, 1) != 1) _exit(127);
+        execvp(argv[cmd], &argv[cmd]);
+        printf("Could not run %s\n", argv[cmd]);
+        _exit(127);
+    }
+    close(go[0]);
+
+    if(!openRings(child)){
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+        return -1;
+    }
+    if(write(go[1], "g", 1) != 1){
+        printf("Could not start the child\n");
+    }
+    close(go[1]);
+
+    struct pollfd fds[PROFILE_MAX_CPUS];
+    for(int i = 0; i < ringCount; i++){
+        fds[i].fd = rings[i].fd;
+        fds[i].events = POLLIN;
+    }
+
+    int status = 0;
+    while(true){
+        poll(fds, ringCount, 100);
+        drainAll();
+        if(waitpid(child, &status, WNOHANG) == child) break;
+    }
+    drainAll();
+
+    printf("\n%s exited with %d\n", argv[cmd], WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+
+    FILE* probes = stdout;
+    if(probePath){
+        probes = fopen(probePath, "w");
+        if(!probes){
+            printf("Could not open %s, writing probes to stdout\n", probePath);
+            probes = stdout;
+        }
+    }
+    report(top, probes);
+    if(probes != stdout) fclose(probes);
+    return 0;
+}
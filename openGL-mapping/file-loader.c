@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "loader.h"
+#include "mapping-backend.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Streams a file into a mapping from mapping-backend.c with every mode loader.c has and reports
+ * MB/s, syscalls and faults for each. Every mode gets a fresh mapping, so the first touch
+ * faults are part of every number, that's what a real load into a new buffer costs too.
+ *
+ * Without a file a test file gets created on /dev/shm (tmpfs), so this runs anywhere.
+ * The file is read once up front, the numbers are for a file in the page cache.
+ *
+ * usage: file-loader [file] [--memfd] [--chunk KB] [--size MB]
+ */
+
+#define LOADER_DEFAULT_CHUNK (1024*1024)
+#define LOADER_DEFAULT_SIZE (64*1024*1024)
+#define LOADER_PAGE 4096
+
+static bool createTestFile(char* path, size_t size){
+    strcpy(path, "/dev/shm/file-loader-XXXXXX");
+    int fd = mkstemp(path);
+    if(fd < 0){
+        printf("Could not create a test file in /dev/shm\n");
+        return false;
+    }
+    char* block = malloc(LOADER_DEFAULT_CHUNK);
+    bool ok = true;
+    for(size_t pos = 0; pos < size && ok; pos += LOADER_DEFAULT_CHUNK){
+        size_t n = size - pos < LOADER_DEFAULT_CHUNK ? size - pos : LOADER_DEFAULT_CHUNK;
+        for(size_t i = 0; i < n; i++){
+            block[i] = (pos + i) * 7 + ((pos + i) >> 12);
+        }
+        ok = write(fd, block, n) == n;
+    }
+    free(block);
+    close(fd);
+    if(!ok){
+        printf("Could not write the test file\n");
+        unlink(path);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv){
+    const char* path = NULL;
+    char tmpPath[64];
+    bool created = false;
+    bool forceMemfd = false;
+    size_t chunk = LOADER_DEFAULT_CHUNK;
+    size_t testSize = LOADER_DEFAULT_SIZE;
+
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--memfd")){
+            forceMemfd = true;
+        }else if(!strcmp(argv[i], "--chunk") && i + 1 < argc){
+            chunk = (size_t)atoi(argv[++i]) * 1024;
+        }else if(!strcmp(argv[i], "--size") && i + 1 < argc){
+            testSize = (size_t)atoi(argv[++i]) * 1024 * 1024;
+        }else if(argv[i][0] != '-' && !path){
+            path = argv[i];
+        }else{
+            path = NULL;
+            chunk = 0;
+            break;
+        }
+    }
+    if(chunk == 0 || chunk % LOADER_PAGE || testSize == 0){
+        printf("usage: %s [file] [--memfd] [--chunk KB] [--size MB]\n", argv[0]);
+        printf("the chunk size has to be a multiple of 4KB\n");
+        return -1;
+    }
+
+    if(!path){
+        if(!createTestFile(tmpPath, testSize)){
+            return -1;
+        }
+        path = tmpPath;
+        created = true;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) || st.st_size == 0){
+        printf("Could not open %s (or it is empty)\n", path);
+        if(created) unlink(path);
+        return -1;
+    }
+    size_t size = st.st_size;
+
+    // reference copy for checking, this also gets the file into the page cache
+    void* expected = malloc(size);
+    if(!expected || pread(fd, expected, size, 0) != size){
+        printf("Could not read %s\n", path);
+        if(created) unlink(path);
+        return -1;
+    }
+
+    size_t mapSize = (size + LOADER_PAGE - 1) & ~(size_t)(LOADER_PAGE - 1);
+    printf("Loading %s (%zu bytes) in %zu KB chunks\n", path, size, chunk / 1024);
+    printf("%-10s %10s %10s %12s %14s %10s\n", "mode", "MB/s", "syscalls", "minor faults", "align faults", "");
+
+    int failures = 0;
+    for(enum loadMode mode = LOAD_STAGED; mode <= LOAD_URING; mode++){
+        if(!loadModeAvailable(mode)){
+            printf("%-10s not built in (needs liburing)\n", loadModeName(mode));
+            continue;
+        }
+        struct mapping m;
+        bool mapped = forceMemfd ? mapMemfd(&m, mapSize) : mapAny(&m, mapSize);
+        if(!mapped){
+            printf("Could not create a mapping\n");
+            failures++;
+            break;
+        }
+        resultsSetTool("file-loader");
+        resultsSetMapping(&m);
+
+        struct loadStats stats;
+        bool ok = loadFile(fd, 0, size, m.addr, chunk, mode, &stats) && mappingMatches(m.addr, expected, size);
+        if(!ok){
+            failures++;
+        }
+        double mbs = recordCopyRun(stats.bytes, stats.ns, stats.alignmentFaults, ok, "load.%s", loadModeName(mode));
+        printf("%-10s %10.1f %10ld %12ld %14ld %10s\n", loadModeName(mode), mbs, stats.syscalls,
+            stats.minorFaults, stats.alignmentFaults, ok ? "ok" : "MISMATCH");
+        unmapMapping(&m);
+    }
+
+    free(expected);
+    close(fd);
+    if(created){
+        unlink(path);
+    }
+    return failures ? 1 : 0;
+}
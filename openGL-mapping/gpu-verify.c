@@ -0,0 +1,279 @@
+#include "gpu-verify.h"
+#include "shaders.h"
+#include "copy.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Checks uploaded data on the GPU instead of reading it back through the mapping.
+ * A compute shader hashes every 32bit word together with its index and reduces that into
+ * two words (a sum and a xor), the CPU does the same over the data it copied and only those
+ * 8 bytes have to come back.
+ *
+ * Needs compute shaders and SSBOs (GL 4.3), llvmpipe has both.
+ */
+
+#define VERIFY_GROUP_SIZE 256
+#define VERIFY_MAX_GROUPS 1024
+
+#define VERIFY_WIDTH 1280
+#define VERIFY_HEIGHT 720
+#define VERIFY_FRAMES 100
+
+// has to be kept in sync with mixWord in the shaders
+#define VERIFY_MIX \
+"uint mixWord(uint w, uint i){\n" \
+"uint h = w ^ (i * 0x9e3779b9u);\n" \
+"h ^= h >> 16;\n" \
+"h *= 0x7feb352du;\n" \
+"h ^= h >> 15;\n" \
+"h *= 0x846ca68bu;\n" \
+"h ^= h >> 16;\n" \
+"return h;\n" \
+"}\n"
+
+#define VERIFY_REDUCE \
+"void reduce(uint acc, uint accXor){\n" \
+"atomicAdd(digestSum, acc);\n" \
+"atomicXor(digestXor, accXor);\n" \
+"}\n"
+
+const char* bufferDigest_Shader =
+"#version 430\n"
+"layout (local_size_x = 256) in;\n"
+"layout (std430, binding = 0) readonly buffer Data { uint words[]; };\n"
+"layout (std430, binding = 1) buffer Digest { uint digestSum; uint digestXor; };\n"
+"uniform uint wordCount;\n"
+VERIFY_MIX
+VERIFY_REDUCE
+"void main(){\n"
+"uint acc = 0u;\n"
+"uint accXor = 0u;\n"
+"uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;\n"
+"for(uint i = gl_GlobalInvocationID.x; i < wordCount; i += stride){\n"
+"uint h = mixWord(words[i], i);\n"
+"acc += h;\n"
+"accXor ^= h * 0x2c1b3c6du;\n"
+"}\n"
+"reduce(acc, accXor);\n"
+"}";
+
+// every texel is turned back into the 32bit word it was uploaded from (RGBA8, little endian)
+const char* textureDigest_Shader =
+"#version 430\n"
+"layout (local_size_x = 256) in;\n"
+"layout (std430, binding = 1) buffer Digest { uint digestSum; uint digestXor; };\n"
+"uniform sampler2D text;\n"
+"uniform uint width;\n"
+"uniform uint firstRow;\n"
+"uniform uint wordCount;\n"
+VERIFY_MIX
+VERIFY_REDUCE
+"void main(){\n"
+"uint acc = 0u;\n"
+"uint accXor = 0u;\n"
+"uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;\n"
+"for(uint i = gl_GlobalInvocationID.x; i < wordCount; i += stride){\n"
+"uvec4 c = uvec4(round(texelFetch(text, ivec2(i % width, firstRow + i / width), 0) * 255.0));\n"
+"uint w = c.r | (c.g << 8) | (c.b << 16) | (c.a << 24);\n"
+"uint h = mixWord(w, i);\n"
+"acc += h;\n"
+"accXor ^= h * 0x2c1b3c6du;\n"
+"}\n"
+"reduce(acc, accXor);\n"
+"}";
+
+static GLuint bufferProg = 0;
+static GLuint textureProg = 0;
+static GLuint digestBuffer = 0;
+
+static uint32_t mixWord(uint32_t w, uint32_t i){
+    uint32_t h = w ^ (i * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+struct gpuDigest cpuDigest(const void* data, size_t words){
+    struct gpuDigest digest = {0, 0};
+    const uint32_t* p = data;
+    for(size_t i = 0; i < words; i++){
+        uint32_t w;
+        memcpy(&w, p + i, 4);   // data may not be aligned
+        uint32_t h = mixWord(w, i);
+        digest.sum += h;
+        digest.xorSum ^= h * 0x2c1b3c6du;
+    }
+    return digest;
+}
+
+bool gpuVerifyInit(){
+    if(digestBuffer){
+        return true;
+    }
+    if(!GLEW_ARB_compute_shader || !GLEW_ARB_shader_storage_buffer_object){
+        printf("Compute shaders or SSBOs not supported, can't verify on the GPU\n");
+        return false;
+    }
+    bufferProg = compileComputeProgram(bufferDigest_Shader);
+    textureProg = compileComputeProgram(textureDigest_Shader);
+    if(bufferProg == 0 || textureProg == 0){
+        return false;
+    }
+    glGenBuffers(1, &digestBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, digestBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(struct gpuDigest), NULL, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+}
+
+static GLuint groupsFor(size_t words){
+    size_t groups = (words + VERIFY_GROUP_SIZE - 1) / VERIFY_GROUP_SIZE;
+    if(groups > VERIFY_MAX_GROUPS) groups = VERIFY_MAX_GROUPS;
+    if(groups < 1) groups = 1;
+    return groups;
+}
+
+static void resetDigest(){
+    struct gpuDigest zero = {0, 0};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, digestBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, digestBuffer);
+}
+
+static bool readDigest(struct gpuDigest* out){
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, digestBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(*out), out);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GLenum err = glGetError();
+    if(err != GL_NO_ERROR){
+        printf("Digest readback failed (err: %d)\n", err);
+        return false;
+    }
+    return true;
+}
+
+// offset has to be a multiple of GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+static bool dispatchBufferDigest(GLuint buffer, GLintptr offset, size_t words){
+    if(!gpuVerifyInit()) return false;
+    resetDigest();
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, buffer, offset, words * 4);
+    glUseProgram(bufferProg);
+    glUniform1ui(glGetUniformLocation(bufferProg, "wordCount"), words);
+    glDispatchCompute(groupsFor(words), 1, 1);
+    glFlush();
+    return true;
+}
+
+static bool dispatchTextureDigest(GLuint tex, int width, int firstRow, int rows){
+    if(!gpuVerifyInit()) return false;
+    resetDigest();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glUseProgram(textureProg);
+    glUniform1i(glGetUniformLocation(textureProg, "text"), 0);
+    glUniform1ui(glGetUniformLocation(textureProg, "width"), width);
+    glUniform1ui(glGetUniformLocation(textureProg, "firstRow"), firstRow);
+    glUniform1ui(glGetUniformLocation(textureProg, "wordCount"), (size_t)width * rows);
+    glDispatchCompute(groupsFor((size_t)width * rows), 1, 1);
+    glFlush();
+    return true;
+}
+
+bool gpuDigestBuffer(GLuint buffer, GLintptr offset, size_t words, struct gpuDigest* out){
+    return dispatchBufferDigest(buffer, offset, words) && readDigest(out);
+}
+
+bool gpuDigestTexture(GLuint tex, int width, int firstRow, int rows, struct gpuDigest* out){
+    return dispatchTextureDigest(tex, width, firstRow, rows) && readDigest(out);
+}
+
+static bool compareDigest(const char* what, struct gpuDigest gpu, struct gpuDigest cpu){
+    if(gpu.sum != cpu.sum || gpu.xorSum != cpu.xorSum){
+        printf("%s digest mismatch! GPU: %08x %08x CPU: %08x %08x\n", what, gpu.sum, gpu.xorSum, cpu.sum, cpu.xorSum);
+        return false;
+    }
+    return true;
+}
+
+// the CPU side gets hashed while the GPU is busy with its half
+bool gpuVerifyBuffer(GLuint buffer, GLintptr offset, const void* expected, size_t words){
+    struct gpuDigest gpu;
+    if(!dispatchBufferDigest(buffer, offset, words)) return false;
+    struct gpuDigest cpu = cpuDigest(expected, words);
+    if(!readDigest(&gpu)) return false;
+    return compareDigest("Buffer", gpu, cpu);
+}
+
+// expected points at the first texel of firstRow. The texture has to be complete, so no mipmap filtering without mipmaps
+bool gpuVerifyTexture(GLuint tex, int width, int firstRow, int rows, const void* expected){
+    struct gpuDigest gpu;
+    if(!dispatchTextureDigest(tex, width, firstRow, rows)) return false;
+    struct gpuDigest cpu = cpuDigest(expected, (size_t)width * rows);
+    if(!readDigest(&gpu)) return false;
+    return compareDigest("Texture", gpu, cpu);
+}
+
+// copy -> upload per frame, once without and once with verifying every frame
+static double verifyFrames(bool verify, GLuint tex, void* map, void* src, int* failures){
+    size_t size = VERIFY_WIDTH*VERIFY_HEIGHT*4;
+    glFinish();
+    uint64_t start = nowNs();
+    for(int frame = 0; frame < VERIFY_FRAMES; frame++){
+        *(uint32_t*)src = frame;
+        this_memcpy_quiet(map, src, size);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VERIFY_WIDTH, VERIFY_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        if(verify){
+            if(!gpuVerifyTexture(tex, VERIFY_WIDTH, 0, VERIFY_HEIGHT, src)){
+                (*failures)++;
+            }
+        }else{
+            // the verifying run has to wait for the upload anyway, so this one does too
+            glFinish();
+        }
+    }
+    return (double)VERIFY_FRAMES / ((double)(nowNs() - start) / 1e9);
+}
+
+void runVerifyThroughputTest(){
+    if(!gpuVerifyInit()) return;
+
+    size_t size = VERIFY_WIDTH*VERIFY_HEIGHT*4;
+    GLuint buffer, tex;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    void* map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VERIFY_WIDTH, VERIFY_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    void* src = malloc(size);
+    for(size_t i = 0; i < size; i++){
+        ((unsigned char*)src)[i] = i * 7;
+    }
+
+    int failures = 0;
+    double plain = verifyFrames(false, tex, map, src, &failures);
+    double verified = verifyFrames(true, tex, map, src, &failures);
+    printf("\nGPU verification: %.1f frames/s without, %.1f frames/s verifying every frame (%d mismatches)\n",
+        plain, verified, failures);
+    recordResult(plain, "frames/s", RESULT_HIGHER_BETTER, "verify.without");
+    recordResult(verified, "frames/s", RESULT_HIGHER_BETTER, "verify.every frame");
+    recordResult(failures, "failures", RESULT_LOWER_BETTER, "verify.mismatches");
+
+    free(src);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    glDeleteTextures(1, &tex);
+    glUseProgram(0);
+}
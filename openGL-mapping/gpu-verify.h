@@ -0,0 +1,18 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct gpuDigest {
+    uint32_t sum;
+    uint32_t xorSum;
+};
+
+bool gpuVerifyInit();
+struct gpuDigest cpuDigest(const void* data, size_t words);
+bool gpuDigestBuffer(GLuint buffer, GLintptr offset, size_t words, struct gpuDigest* out);
+bool gpuDigestTexture(GLuint tex, int width, int firstRow, int rows, struct gpuDigest* out);
+bool gpuVerifyBuffer(GLuint buffer, GLintptr offset, const void* expected, size_t words);
+bool gpuVerifyTexture(GLuint tex, int width, int firstRow, int rows, const void* expected);
+void runVerifyThroughputTest();
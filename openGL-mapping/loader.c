@@ -0,0 +1,185 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#if HAVE_LIBURING==1
+#include <liburing.h>
+#endif
+
+#include "loader.h"
+#include "copy.h"
+#include "bench.h"
+
+/*
+ * Streams a file into a mapping in chunk sized pieces, instead of reading all of it into a
+ * malloc'd buffer first and copying that over like main.c does with tmp.
+ *
+ * Staged mode keeps one chunk sized bounce buffer in normal memory, so the kernel only ever
+ * writes to normal memory and the stores into the mapping are device_memcpy's aligned ones.
+ * The direct modes hand the mapping to the kernel, which then does the copy itself
+ * (copy_to_user), with whatever instructions the kernel's copy routine uses.
+ *
+ * dst and chunk should be page aligned, that keeps every read aligned on both sides.
+ */
+
+// reads in flight for the io_uring mode
+#define LOAD_URING_DEPTH 8
+
+bool loadModeAvailable(enum loadMode mode){
+#if HAVE_LIBURING==1
+    return true;
+#else
+    return mode != LOAD_URING;
+#endif
+}
+
+const char* loadModeName(enum loadMode mode){
+    switch(mode){
+        case LOAD_STAGED: return "staged";
+        case LOAD_READ: return "read";
+        case LOAD_URING: return "io_uring";
+    }
+    return "unknown";
+}
+
+// pread until everything is there, a short read isn't an error
+static bool readFully(int fd, void* dst, size_t n, off_t offset, struct loadStats* stats){
+    size_t done = 0;
+    while(done < n){
+        ssize_t got = pread(fd, dst + done, n - done, offset + done);
+        stats->syscalls++;
+        if(got < 0){
+            if(errno == EINTR) continue;
+            printf("pread failed (%s)\n", strerror(errno));
+            return false;
+        }
+        if(got == 0){
+            printf("File ended %zu bytes early\n", n - done);
+            return false;
+        }
+        done += got;
+    }
+    return true;
+}
+
+static bool loadStaged(int fd, off_t offset, size_t size, void* dst, size_t chunk, struct loadStats* stats){
+    void* bounce = aligned_alloc(4096, (chunk + 4095) & ~(size_t)4095);
+    if(!bounce){
+        printf("Could not allocate the bounce buffer\n");
+        return false;
+    }
+    bool ok = true;
+    for(size_t pos = 0; pos < size && ok; pos += chunk){
+        size_t n = size - pos < chunk ? size - pos : chunk;
+        ok = readFully(fd, bounce, n, offset + pos, stats);
+        if(ok){
+            device_memcpy(dst + pos, bounce, n);
+        }
+    }
+    free(bounce);
+    return ok;
+}
+
+static bool loadRead(int fd, off_t offset, size_t size, void* dst, size_t chunk, struct loadStats* stats){
+    for(size_t pos = 0; pos < size; pos += chunk){
+        size_t n = size - pos < chunk ? size - pos : chunk;
+        if(!readFully(fd, dst + pos, n, offset + pos, stats)){
+            return false;
+        }
+    }
+    return true;
+}
+
+#if HAVE_LIBURING==1
+static bool loadUring(int fd, off_t offset, size_t size, void* dst, size_t chunk, struct loadStats* stats){
+    struct io_uring ring;
+    int ret = io_uring_queue_init(LOAD_URING_DEPTH, &ring, 0);
+    stats->syscalls++;
+    if(ret < 0){
+        printf("io_uring_queue_init failed (%s)\n", strerror(-ret));
+        return false;
+    }
+
+    size_t queued = 0, completed = 0;
+    int inFlight = 0;
+    bool ok = true;
+    while(ok && completed < size){
+        while(inFlight < LOAD_URING_DEPTH && queued < size){
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            if(!sqe) break;
+            size_t n = size - queued < chunk ? size - queued : chunk;
+            io_uring_prep_read(sqe, fd, dst + queued, n, offset + queued);
+            io_uring_sqe_set_data(sqe, (void*)(uintptr_t)queued);
+            queued += n;
+            inFlight++;
+        }
+
+        ret = io_uring_submit_and_wait(&ring, 1);
+        stats->syscalls++;
+        if(ret < 0){
+            if(ret == -EINTR) continue;
+            printf("io_uring_submit_and_wait failed (%s)\n", strerror(-ret));
+            ok = false;
+            break;
+        }
+
+        struct io_uring_cqe* cqe;
+        while(io_uring_peek_cqe(&ring, &cqe) == 0){
+            size_t pos = (uintptr_t)io_uring_cqe_get_data(cqe);
+            size_t n = size - pos < chunk ? size - pos : chunk;
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            inFlight--;
+
+            if(res < 0){
+                printf("io_uring read failed (%s)\n", strerror(-res));
+                ok = false;
+            }else if(res < n){
+                // rare, the rest just gets read synchronously
+                ok &= readFully(fd, dst + pos + res, n - res, offset + pos + res, stats);
+            }
+            completed += n;
+        }
+    }
+
+    // nothing may still be writing into the mapping once this returns
+    while(inFlight > 0){
+        struct io_uring_cqe* cqe;
+        if(io_uring_wait_cqe(&ring, &cqe) < 0) break;
+        io_uring_cqe_seen(&ring, cqe);
+        inFlight--;
+    }
+    io_uring_queue_exit(&ring);
+    return ok;
+}
+#endif
+
+bool loadFile(int fd, off_t offset, size_t size, void* dst, size_t chunk, enum loadMode mode, struct loadStats* stats){
+    memset(stats, 0, sizeof(*stats));
+    if(!loadModeAvailable(mode)){
+        printf("%s isn't available in this build\n", loadModeName(mode));
+        return false;
+    }
+
+    long faults = minorFaults();
+    long alignFaults = alignmentFaults();
+    uint64_t start = nowNs();
+    bool ok = false;
+    switch(mode){
+        case LOAD_STAGED:
+            ok = loadStaged(fd, offset, size, dst, chunk, stats);
+            break;
+        case LOAD_READ:
+            ok = loadRead(fd, offset, size, dst, chunk, stats);
+            break;
+        case LOAD_URING:
+#if HAVE_LIBURING==1
+            ok = loadUring(fd, offset, size, dst, chunk, stats);
+#endif
+            break;
+    }
+    stats->ns = nowNs() - start;
+    stats->bytes = size;
+    stats->minorFaults = minorFaults() - faults;
+    stats->alignmentFaults = alignFaults < 0 ? -1 : alignmentFaults() - alignFaults;
+    return ok;
+}
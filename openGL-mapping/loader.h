@@ -0,0 +1,23 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+enum loadMode {
+    LOAD_STAGED,  // pread into a bounce buffer, device_memcpy into the mapping
+    LOAD_READ,    // pread straight into the mapping
+    LOAD_URING    // io_uring reads straight into the mapping, only with HAVE_LIBURING
+};
+
+struct loadStats {
+    size_t bytes;
+    uint64_t ns;
+    long syscalls;
+    long minorFaults;
+    long alignmentFaults;   // -1 if the counter isn't available
+};
+
+bool loadModeAvailable(enum loadMode mode);
+const char* loadModeName(enum loadMode mode);
+bool loadFile(int fd, off_t offset, size_t size, void* dst, size_t chunk, enum loadMode mode, struct loadStats* stats);
@@ -0,0 +1,262 @@
+#include <string.h>
+
+#include "lz4-map.h"
+#include "copy.h"
+
+/*
+ * LZ4 block format (no frame header), decompressed straight into a mapping.
+ *
+ * Decompressing into normal memory and copying that into the mapping moves every byte twice.
+ * Decompressing into the mapping directly is worse though: match copies read earlier output
+ * back, which would be reads from uncached device memory, and literals and matches start at
+ * any byte, so the stores would be unaligned.
+ *
+ * lz4DecompressToMapping decodes into a small window in normal memory instead. It holds the
+ * last 64KB of output (the furthest back an LZ4 match can reach) plus room for new output.
+ * Whenever LZ4_FLUSH_CHUNK bytes are ready they go into the mapping with device_memcpy, so the
+ * mapping only ever sees aligned stores and is never read. The window is small enough to stay
+ * in the cache.
+ *
+ * dst has to be at least 8 byte aligned for that, a mapping always is.
+ *
+ * lz4Decompress is the plain version for normal memory, lz4Compress a simple greedy compressor
+ * (one hash table lookup per position) that's good enough to produce test data.
+ */
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_LAST_LITERALS 5     // the last 5 bytes are always literals
+#define LZ4_MATCH_LIMIT 12      // no match may start in the last 12 bytes
+#define LZ4_HASH_BITS 14
+
+#define LZ4_WINDOW (64*1024)
+#define LZ4_FLUSH_CHUNK (64*1024)
+
+static uint32_t read32(const uint8_t* p){
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t hashPosition(const uint8_t* p){
+    return (read32(p) * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// the 4 bit length in a token continues in extra bytes if it is 15
+static uint8_t* writeLength(uint8_t* out, size_t len){
+    while(len >= 255){
+        *out++ = 255;
+        len -= 255;
+    }
+    *out++ = len;
+    return out;
+}
+
+static uint8_t* writeSequence(uint8_t* out, const uint8_t* literals, size_t literalLen, size_t offset, size_t matchLen){
+    uint8_t* token = out++;
+    *token = (literalLen >= 15 ? 15 : literalLen) << 4;
+    if(literalLen >= 15){
+        out = writeLength(out, literalLen - 15);
+    }
+    memcpy(out, literals, literalLen);
+    out += literalLen;
+    if(matchLen == 0){
+        return out; // last sequence, literals only
+    }
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+    matchLen -= LZ4_MIN_MATCH;
+    *token |= matchLen >= 15 ? 15 : matchLen;
+    if(matchLen >= 15){
+        out = writeLength(out, matchLen - 15);
+    }
+    return out;
+}
+
+size_t lz4Compress(const void* src, size_t srcSize, void* dst, size_t dstCapacity){
+    if(dstCapacity < LZ4_COMPRESS_BOUND(srcSize)){
+        return 0;
+    }
+    const uint8_t* in = src;
+    uint8_t* out = dst;
+    uint32_t* table = calloc(1 << LZ4_HASH_BITS, sizeof(uint32_t));
+    if(!table){
+        return 0;
+    }
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    // table entries are position + 1, 0 means empty
+    while(srcSize > LZ4_MATCH_LIMIT && pos < srcSize - LZ4_MATCH_LIMIT){
+        uint32_t h = hashPosition(in + pos);
+        size_t candidate = table[h];
+        table[h] = pos + 1;
+        if(candidate == 0 || pos - (candidate - 1) > LZ4_MAX_OFFSET ||
+           read32(in + candidate - 1) != read32(in + pos)){
+            pos++;
+            continue;
+        }
+        candidate--;
+
+        size_t len = LZ4_MIN_MATCH;
+        while(pos + len < srcSize - LZ4_LAST_LITERALS && in[candidate + len] == in[pos + len]){
+            len++;
+        }
+        out = writeSequence(out, in + anchor, pos - anchor, pos - candidate, len);
+        pos += len;
+        anchor = pos;
+    }
+    out = writeSequence(out, in + anchor, srcSize - anchor, 0, 0);
+    free(table);
+    return out - (uint8_t*)dst;
+}
+
+// returns false if the length runs past the end of the input
+static bool readLength(const uint8_t** in, const uint8_t* end, size_t* len){
+    uint8_t b;
+    do{
+        if(*in >= end) return false;
+        b = *(*in)++;
+        *len += b;
+    }while(b == 255);
+    return true;
+}
+
+long lz4Decompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity){
+    const uint8_t* in = src;
+    const uint8_t* end = in + srcSize;
+    uint8_t* out = dst;
+    uint8_t* outEnd = out + dstCapacity;
+
+    while(in < end){
+        uint8_t token = *in++;
+        size_t literalLen = token >> 4;
+        if(literalLen == 15 && !readLength(&in, end, &literalLen)) return -1;
+        if(literalLen > end - in || literalLen > outEnd - out) return -1;
+        memcpy(out, in, literalLen);
+        in += literalLen;
+        out += literalLen;
+        if(in == end) break; // the last sequence has no match
+
+        if(end - in < 2) return -1;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t matchLen = token & 15;
+        if(matchLen == 15 && !readLength(&in, end, &matchLen)) return -1;
+        matchLen += LZ4_MIN_MATCH;
+        if(offset == 0 || offset > out - (uint8_t*)dst || matchLen > outEnd - out) return -1;
+
+        const uint8_t* match = out - offset;
+        if(offset >= matchLen){
+            memcpy(out, match, matchLen);
+            out += matchLen;
+        }else{
+            // overlapping, repeats the last offset bytes
+            for(size_t i = 0; i < matchLen; i++){
+                *out++ = *match++;
+            }
+        }
+    }
+    return out - (uint8_t*)dst;
+}
+
+struct lz4Window {
+    uint8_t buf[LZ4_WINDOW + LZ4_FLUSH_CHUNK];
+    size_t pos;         // next free byte in buf
+    size_t base;        // output position of buf[0]
+    size_t flushed;     // output written to the mapping so far
+    void* dst;
+};
+
+// writes everything up to pos (rounded down to 8 bytes unless final) into the mapping
+static void windowFlush(struct lz4Window* w, bool final){
+    size_t upTo = w->base + w->pos;
+    if(!final){
+        upTo &= ~(size_t)7;
+    }
+    if(upTo > w->flushed){
+        device_memcpy(w->dst + w->flushed, w->buf + (w->flushed - w->base), upTo - w->flushed);
+        w->flushed = upTo;
+    }
+}
+
+// makes room for at least one byte, keeping the 64KB matches can reach and anything not flushed yet
+static void windowMakeRoom(struct lz4Window* w){
+    if(w->pos < sizeof(w->buf)){
+        return;
+    }
+    windowFlush(w, false);
+    size_t keepFrom = w->pos - LZ4_WINDOW;
+    if(w->flushed - w->base < keepFrom){
+        keepFrom = w->flushed - w->base;
+    }
+    memmove(w->buf, w->buf + keepFrom, w->pos - keepFrom);
+    w->pos -= keepFrom;
+    w->base += keepFrom;
+}
+
+static size_t windowSpace(struct lz4Window* w){
+    windowMakeRoom(w);
+    return sizeof(w->buf) - w->pos;
+}
+
+long lz4DecompressToMapping(const void* src, size_t srcSize, void* dst, size_t dstCapacity){
+    const uint8_t* in = src;
+    const uint8_t* end = in + srcSize;
+    struct lz4Window* w = malloc(sizeof(*w));
+    if(!w){
+        return -1;
+    }
+    w->pos = 0;
+    w->base = 0;
+    w->flushed = 0;
+    w->dst = dst;
+    long result = -1;
+
+    while(in < end){
+        uint8_t token = *in++;
+        size_t literalLen = token >> 4;
+        if(literalLen == 15 && !readLength(&in, end, &literalLen)) goto out;
+        if(literalLen > end - in || literalLen > dstCapacity - (w->base + w->pos)) goto out;
+        // long literal runs don't fit into the window in one go
+        while(literalLen){
+            size_t n = windowSpace(w);
+            if(n > literalLen) n = literalLen;
+            memcpy(w->buf + w->pos, in, n);
+            w->pos += n;
+            in += n;
+            literalLen -= n;
+        }
+        if(in == end) break;
+
+        if(end - in < 2) goto out;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t matchLen = token & 15;
+        if(matchLen == 15 && !readLength(&in, end, &matchLen)) goto out;
+        matchLen += LZ4_MIN_MATCH;
+        if(offset == 0 || offset > w->base + w->pos || matchLen > dstCapacity - (w->base + w->pos)) goto out;
+
+        // the source is always in the window, at least 64KB of history are kept
+        while(matchLen){
+            size_t n = windowSpace(w);
+            if(n > matchLen) n = matchLen;
+            uint8_t* out = w->buf + w->pos;
+            const uint8_t* match = out - offset;
+            if(offset >= n){
+                memcpy(out, match, n);
+            }else{
+                for(size_t i = 0; i < n; i++){
+                    out[i] = match[i];
+                }
+            }
+            w->pos += n;
+            matchLen -= n;
+        }
+    }
+    windowFlush(w, true);
+    result = w->flushed;
+out:
+    free(w);
+    return result;
+}
@@ -0,0 +1,12 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// worst case size of lz4Compress's output
+#define LZ4_COMPRESS_BOUND(n) ((n) + (n) / 255 + 16)
+
+size_t lz4Compress(const void* src, size_t srcSize, void* dst, size_t dstCapacity);
+// both return the decompressed size, -1 if the input is broken or doesn't fit
+long lz4Decompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity);
+long lz4DecompressToMapping(const void* src, size_t srcSize, void* dst, size_t dstCapacity);
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4-map.h"
+#include "mapping-backend.h"
+#include "copy.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Unpacks LZ4 compressed RGBA textures into a mapping from mapping-backend.c, once the usual
+ * way (lz4Decompress into a heap buffer, then this_memcpy into the mapping) and once with
+ * lz4DecompressToMapping, which never reads the mapping and only stores aligned into it.
+ *
+ * The textures are generated: smooth gradients with noisy blocks in between, which compresses
+ * about as well as typical color textures do. MB/s is for the decompressed size.
+ *
+ * usage: lz4-stream [--memfd] [--reps N]
+ */
+
+#define LZ4_STREAM_DEFAULT_REPS 10
+#define LZ4_STREAM_PAGE 4096
+
+struct textureSize {
+    const char* name;
+    int width, height;
+};
+
+static const struct textureSize textureSizes[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"4k", 3840, 2160},
+};
+
+static void makeTexture(uint8_t* pixels, int width, int height){
+    uint32_t rng = 0x12345678;
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            uint8_t* p = pixels + ((size_t)y * width + x) * 4;
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            bool noisy = ((x >> 5) + (y >> 5)) % 5 == 0;
+            p[0] = x * 255 / width;
+            p[1] = y * 255 / height;
+            p[2] = noisy ? rng : (x + y) >> 3;
+            p[3] = 255;
+        }
+    }
+}
+
+struct unpackStats {
+    uint64_t ns;
+    long minorFaults;
+    long alignmentFaults;   // -1 if the counter isn't available
+    bool ok;
+};
+
+static void unpack(bool direct, const void* packed, size_t packedSize, void* map, size_t size, void* heap, int reps, struct unpackStats* stats){
+    long faults = minorFaults();
+    long alignFaults = alignmentFaults();
+    uint64_t start = nowNs();
+    stats->ok = true;
+    for(int i = 0; i < reps; i++){
+        long got;
+        if(direct){
+            got = lz4DecompressToMapping(packed, packedSize, map, size);
+        }else{
+            got = lz4Decompress(packed, packedSize, heap, size);
+            if(got == size){
+                this_memcpy_quiet(map, heap, size);
+            }
+        }
+        stats->ok &= got == size;
+    }
+    stats->ns = nowNs() - start;
+    stats->minorFaults = minorFaults() - faults;
+    stats->alignmentFaults = alignFaults < 0 ? -1 : alignmentFaults() - alignFaults;
+}
+
+int main(int argc, char** argv){
+    bool forceMemfd = false;
+    int reps = LZ4_STREAM_DEFAULT_REPS;
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--memfd")){
+            forceMemfd = true;
+        }else if(!strcmp(argv[i], "--reps") && i + 1 < argc){
+            reps = atoi(argv[++i]);
+        }else{
+            reps = 0;
+            break;
+        }
+    }
+    if(reps <= 0){
+        printf("usage: %s [--memfd] [--reps N]\n", argv[0]);
+        return -1;
+    }
+
+    resultsSetTool("lz4-stream");
+    printf("%-6s %8s %-8s %10s %12s %14s %10s\n", "size", "ratio", "path", "MB/s", "minor faults", "align faults", "");
+    int failures = 0;
+    for(int t = 0; t < sizeof(textureSizes) / sizeof(textureSizes[0]); t++){
+        const struct textureSize* ts = &textureSizes[t];
+        size_t size = (size_t)ts->width * ts->height * 4;
+        uint8_t* pixels = malloc(size);
+        uint8_t* packed = malloc(LZ4_COMPRESS_BOUND(size));
+        uint8_t* heap = malloc(size);
+        if(!pixels || !packed || !heap){
+            printf("Out of memory\n");
+            return -1;
+        }
+        makeTexture(pixels, ts->width, ts->height);
+        size_t packedSize = lz4Compress(pixels, size, packed, LZ4_COMPRESS_BOUND(size));
+
+        for(int direct = 0; direct <= 1; direct++){
+            const char* path = direct ? "direct" : "heap";
+            // a fresh mapping each time, the first touch faults are part of the cost
+            struct mapping m;
+            size_t mapSize = (size + LZ4_STREAM_PAGE - 1) & ~(size_t)(LZ4_STREAM_PAGE - 1);
+            bool mapped = forceMemfd ? mapMemfd(&m, mapSize) : mapAny(&m, mapSize);
+            if(!mapped){
+                printf("Could not create a mapping\n");
+                return -1;
+            }
+            resultsSetMapping(&m);
+
+            struct unpackStats stats;
+            unpack(direct, packed, packedSize, m.addr, size, heap, reps, &stats);
+            stats.ok &= mappingMatches(m.addr, pixels, size);
+            failures += !stats.ok;
+            double mbs = recordCopyRun(size * reps, stats.ns, stats.alignmentFaults, stats.ok, "lz4.%s %s", ts->name, path);
+            printf("%-6s %7.2fx %-8s %10.1f %12ld %14ld %10s\n", ts->name, (double)size / packedSize, path, mbs,
+                stats.minorFaults, stats.alignmentFaults, stats.ok ? "ok" : "MISMATCH");
+            unmapMapping(&m);
+        }
+        free(pixels);
+        free(packed);
+        free(heap);
+    }
+    return failures ? 1 : 0;
+}
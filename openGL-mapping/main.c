@@ -6,18 +6,27 @@
 #include <GL/gl.h>
 
 #include "arm64-asmtests.h"
-
-#define ALIGN_MEMCPY 0
-#define ALIGN_MEMCPY_SIZE 4
-#define MEMCPY_64BIT 1
+#include "copy.h"
+#include "shaders.h"
+#include "scaling.h"
+#include "upload-threads.h"
+#include "gpu-verify.h"
+#include "zerocopy.h"
+#include "soak.h"
+#include "stream-ring.h"
+#include "visibility.h"
+#include "rt-upload.h"
+#include "results.h"
 
 #define READ_TEST 1
-
-#if MEMCPY_64BIT==1
-#define MEMCPY_GROUP_SIZE 8
-#else
-#define MEMCPY_GROUP_SIZE 4
-#endif
+#define SCALING_TEST 0
+#define UPLOAD_THREADS_TEST 0
+#define VERIFY_TEST 0
+#define ZEROCOPY_TEST 0
+#define SOAK_TEST 0
+#define STREAM_RING_TEST 0
+#define VISIBILITY_TEST 0
+#define RT_UPLOAD_TEST 0
 
 const char* vtx_Shader = 
 "#version 330\n"
@@ -39,116 +48,6 @@ const char* frg_Shader =
 "colour = vec4(0.1f,col.g,col.b,1.0f);\n"
 "}";
 
-void* this_memcpy(void* dst, const void* src, size_t n){
-	volatile char* vc_src = (char*)src;
-	volatile char* vc_dst = (char*)dst;
-    printf("Copying 0x%llx bytes from 0x%llx to 0x%llx\n",n, src, dst);
-
-	// copy byte by byte, hopefully avoiding any alignment issues
-	size_t pos = 0;
-	/*while(pos < n){
-		if((uint64_t)(pos+vc_src) % 4 != 0 || n-pos <= 4){ // not aligned to 4 bytes, or less than 4 bytes left
-			*(vc_dst+pos) = *(vc_src+pos);	// copy single byte
-			pos++;
-		}
-		if((uint64_t)(pos+vc_src) % 4 == 0 && n-pos > 4){// aligned and more 4 or more bytes left
-			*((volatile uint32_t*)(vc_dst+pos)) = *((volatile uint32_t*)(vc_src+pos));	// copy 4 bytes
-			pos += 4;
-		}
-	}*/
-    while(pos < n){
-#if ALIGN_MEMCPY == 1
-        if((uint64_t)(dst+pos) % 4 != 0 || (uint64_t)(src+pos) % 4 != 0){
-            // one of the addresses isn't aligned
-            *(vc_dst+pos) = *(vc_src+pos);
-            pos++;
-        }
-        if((uint64_t)(dst+pos) % 4 == 0 && (uint64_t)(src+pos) % 4 == 0 && n-pos >= MEMCPY_GROUP_SIZE)
-            // both are aligned
-#else
-        if(n-pos >= MEMCPY_GROUP_SIZE)
-        // we don't care about alignment
-#endif
-        {
-            // copy in large chunks
-#if MEMCPY_64BIT==1
-            *(uint64_t*)(dst + pos) = *(uint64_t*)(src + pos);
-#else       
-            *(uint32_t*)(dst + pos) = *(uint32_t*)(src + pos);
-#endif
-            //*(ptr_dst+pos) = *(ptr_src+pos);
-            pos += MEMCPY_GROUP_SIZE;
-        }
-
-        if(n-pos < MEMCPY_GROUP_SIZE && n-pos != 0){
-            *(vc_dst+pos) = *(vc_src+pos);
-            pos++;
-        }
-    }
-	/*for(size_t i = 0; i < n; i++){
-		*(vc_dst+i) = *(vc_src+i);
-	}*/
-	return dst;
-}
-
-GLuint compileShader(const char* src,GLuint type){
-    GLuint shader;
-    GLuint i = glGetError();
-    shader = glCreateShader(type);
-    i = glGetError();
-    glShaderSource(shader,1,&src,NULL);
-    i = glGetError();
-    glCompileShader(shader);
-    i = glGetError();
-    int success;
-    glGetShaderiv(shader,GL_COMPILE_STATUS,&success);
-    i = glGetError();
-    printf("Creating shader\n");
-    if(!success){
-        GLuint len;
-        i = glGetError();
-        glGetShaderiv(shader,GL_INFO_LOG_LENGTH,&len);
-        i = glGetError();
-        char* buf = (char*)malloc(len+1);
-        glGetShaderInfoLog(shader,len,NULL,buf);
-        i = glGetError();
-        printf("Shader compiling failed:\n%s\n",buf);
-        free(buf);
-        return 0;
-    }
-    return shader;
-}
-
-GLuint compileProgram(const char* vtx, const char* frg){
-    GLuint vertex = compileShader(vtx,GL_VERTEX_SHADER);
-    GLuint fragment = compileShader(frg,GL_FRAGMENT_SHADER);
-    if(vertex == 0 || fragment == 0){
-        // one of the shaders failed to compile
-        return 0;
-    }
-
-    GLuint program = glCreateProgram();
-    glAttachShader(program,vertex);
-    glAttachShader(program,fragment);
-    glLinkProgram(program);
-
-    int success;
-    glGetProgramiv(program,GL_LINK_STATUS,&success);
-    if(!success){
-        GLuint len;
-        glGetProgramiv(program,GL_INFO_LOG_LENGTH,&len);
-        char* buf = (char*)malloc(len+1);
-        glGetProgramInfoLog(program,len,NULL,buf);
-        printf("Shader linking failed:\n%s\n",buf);
-        free(buf);
-        return 0;
-    }
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    printf("Linked Program %d\n",program);
-    return program;
-}
-
 int main(){
 
     // GLFW setup
@@ -160,6 +59,10 @@ int main(){
     }
     
     glfwWindowHint(GLFW_CLIENT_API,GLFW_OPENGL_API);
+#if ZEROCOPY_TEST==1
+    // dma-buf import goes through EGL
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API,GLFW_EGL_CONTEXT_API);
+#endif
     //glfwWindowHint(GLFW_OPENGL_PROFILE,GLFW_OPENGL_CORE_PROFILE);
     window = glfwCreateWindow(1280,720,"Mapping test",NULL,NULL);
     if(!window){
@@ -170,13 +73,36 @@ int main(){
 
     glfwMakeContextCurrent(window);
 
-    if(glewInit() != GLEW_OK){
+    GLenum glewErr = glewInit();
+#if ZEROCOPY_TEST==1
+    // a GLX build of GLEW complains about the missing GLX display with an EGL context, GL itself is fine
+    if(glewErr == GLEW_ERROR_NO_GLX_DISPLAY){
+        glewErr = GLEW_OK;
+    }
+#endif
+    if(glewErr != GLEW_OK){
         printf("GLEW Init Error\n");
         return -1;
     }
 
     printf("%s\n",glGetString(GL_VERSION));
     printf("%s\n",glGetString(GL_RENDERER));
+    resultsSetTool("mapping");
+    resultsSetBackend("gl-pbo");
+    resultsSetRenderer((const char*)glGetString(GL_RENDERER));
+
+#if SCALING_TEST==1
+    runScalingTest();
+#endif
+#if UPLOAD_THREADS_TEST==1
+    runUploadThreadsTest();
+#endif
+#if STREAM_RING_TEST==1
+    runStreamRingTest();
+#endif
+#if VISIBILITY_TEST==1
+    runVisibilityTest();
+#endif
 
     // other GL setup
 
@@ -208,6 +134,12 @@ int main(){
     if(prog == 0){
         return -1;
     }
+#if ZEROCOPY_TEST==1
+    runZeroCopyTest(prog,baseVAO);
+#endif
+#if SOAK_TEST==1
+    runSoakTest(window,prog,baseVAO);
+#endif
     i = glGetError();
     GLuint texBuffer;
     glGenBuffers(1,&texBuffer);
@@ -246,6 +178,10 @@ int main(){
 
     runAsmTests(buf + 256);
 
+#if RT_UPLOAD_TEST==1
+    // the copy below overwrites whatever this leaves in the buffer
+    runRtUpload(buf,1280*720*4);
+#endif
 
 
     // this is the critical part. This can be done a number of ways to mess different things up
@@ -279,6 +215,20 @@ int main(){
     glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,1280,720,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
 
+#if VERIFY_TEST==1
+    // byte 0 never gets written, so the first row (texture) or the first aligned block (buffer) is skipped
+    printf("Verifying the upload on the GPU\n");
+    GLint ssboAlign;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,&ssboAlign);
+    if(gpuVerifyBuffer(texBuffer,ssboAlign,tmp+ssboAlign,(1280*720*4-ssboAlign)/4)){
+        printf("Buffer contents match\n");
+    }
+    if(gpuVerifyTexture(tex,1280,1,719,tmp+1280*4)){
+        printf("Texture contents match\n");
+    }
+    runVerifyThroughputTest();
+#endif
+
     free(tmp);
 
     while(!glfwWindowShouldClose(window)){
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <drm.h>
+#include <drm_mode.h>
+
+#include "mapping-backend.h"
+#include "copy-trace.h"
+#include "results.h"
+
+/*
+ * Mappings that don't need a GL stack. A dumb buffer on a DRM node (a real GPU or vgem) goes
+ * through the kernel's DRM mmap path, which is what the driver hands out for GL buffers too.
+ * If there is no usable DRM node, a memfd is used instead, that at least keeps the rest of the
+ * tests runnable.
+ */
+
+// dumb buffers are created as images, this is the row size used for that
+#define DUMB_PITCH 4096
+#define DUMB_BPP 32
+#define DRM_MAX_NODES 8
+
+static void drmDriverName(int fd, char* name, size_t len){
+    struct drm_version version;
+    memset(&version, 0, sizeof(version));
+    memset(name, 0, len);
+    version.name = name;
+    version.name_len = len - 1;
+    if(ioctl(fd, DRM_IOCTL_VERSION, &version)){
+        strncpy(name, "unknown", len - 1);
+    }
+}
+
+static bool mapDrmNode(struct mapping* m, const char* node, size_t size){
+    int fd = open(node, O_RDWR | O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+
+    struct drm_mode_create_dumb create;
+    memset(&create, 0, sizeof(create));
+    create.width = DUMB_PITCH / (DUMB_BPP / 8);
+    create.height = (size + DUMB_PITCH - 1) / DUMB_PITCH;
+    create.bpp = DUMB_BPP;
+    if(ioctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create)){
+        // render nodes and drivers without dumb buffer support end up here
+        close(fd);
+        return false;
+    }
+
+    struct drm_mode_map_dumb map;
+    memset(&map, 0, sizeof(map));
+    map.handle = create.handle;
+    if(ioctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map)){
+        printf("%s: DRM_IOCTL_MODE_MAP_DUMB failed\n", node);
+        goto destroy;
+    }
+
+    void* addr = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map.offset);
+    if(addr == MAP_FAILED){
+        printf("%s: mmap of the dumb buffer failed\n", node);
+        goto destroy;
+    }
+
+    m->addr = addr;
+    m->size = create.size;
+    m->backend = BACKEND_DRM_DUMB;
+    m->fd = fd;
+    m->handle = create.handle;
+    strncpy(m->node, node, sizeof(m->node) - 1);
+    drmDriverName(fd, m->driver, sizeof(m->driver));
+    if(copyTraceRegister) copyTraceRegister(m->addr, m->size);
+    return true;
+
+destroy:
+    {
+        struct drm_mode_destroy_dumb destroy = { .handle = create.handle };
+        ioctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+    }
+    close(fd);
+    return false;
+}
+
+// tries the card nodes first, those are the ones that support dumb buffers
+bool mapDrmDumb(struct mapping* m, size_t size){
+    char node[32];
+    memset(m, 0, sizeof(*m));
+    for(int i = 0; i < DRM_MAX_NODES; i++){
+        snprintf(node, sizeof(node), "/dev/dri/card%d", i);
+        if(mapDrmNode(m, node, size)) return true;
+    }
+    for(int i = 0; i < DRM_MAX_NODES; i++){
+        snprintf(node, sizeof(node), "/dev/dri/renderD%d", 128 + i);
+        if(mapDrmNode(m, node, size)) return true;
+    }
+    return false;
+}
+
+bool mapMemfd(struct mapping* m, size_t size){
+    memset(m, 0, sizeof(*m));
+    int fd = memfd_create("mapping-test", MFD_CLOEXEC);
+    if(fd < 0){
+        printf("memfd_create failed\n");
+        return false;
+    }
+    if(ftruncate(fd, size)){
+        printf("Could not resize the memfd to %zu bytes\n", size);
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED){
+        printf("mmap of the memfd failed\n");
+        close(fd);
+        return false;
+    }
+    m->addr = addr;
+    m->size = size;
+    m->backend = BACKEND_MEMFD;
+    m->fd = fd;
+    if(copyTraceRegister) copyTraceRegister(m->addr, m->size);
+    return true;
+}
+
+bool mapAny(struct mapping* m, size_t size){
+    if(mapDrmDumb(m, size)){
+        return true;
+    }
+    printf("No DRM node with dumb buffer support, falling back to memfd\n");
+    return mapMemfd(m, size);
+}
+
+void unmapMapping(struct mapping* m){
+    if(m->addr){
+        if(copyTraceUnregister) copyTraceUnregister(m->addr);
+        munmap(m->addr, m->size);
+    }
+    if(m->backend == BACKEND_DRM_DUMB){
+        struct drm_mode_destroy_dumb destroy = { .handle = m->handle };
+        ioctl(m->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+    }
+    if(m->fd >= 0){
+        close(m->fd);
+    }
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+}
+
+const char* backendName(struct mapping* m){
+    switch(m->backend){
+        case BACKEND_DRM_DUMB: return "drm-dumb";
+        case BACKEND_MEMFD: return "memfd";
+    }
+    return "unknown";
+}
+
+void resultsSetMapping(struct mapping* m){
+    resultsSetBackend(backendName(m));
+    resultsSetRenderer(m->backend == BACKEND_DRM_DUMB ? m->driver : NULL);
+}
+
+bool mappingMatches(const void* map, const void* expected, size_t size){
+    size_t pos = 0;
+    for(; pos + 8 <= size; pos += 8){
+        uint64_t want;
+        memcpy(&want, expected + pos, 8);
+        if(*(volatile uint64_t*)(map + pos) != want) return false;
+    }
+    for(; pos < size; pos++){
+        if(*(volatile uint8_t*)(map + pos) != ((uint8_t*)expected)[pos]) return false;
+    }
+    return true;
+}
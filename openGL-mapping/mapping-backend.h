@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+enum mappingBackend {
+    BACKEND_DRM_DUMB,
+    BACKEND_MEMFD
+};
+
+struct mapping {
+    void* addr;
+    size_t size;
+    enum mappingBackend backend;
+    int fd;             // DRM node or memfd
+    uint32_t handle;    // dumb buffer handle, DRM only
+    char node[32];      // which DRM node, empty for memfd
+    char driver[32];    // DRM driver name, e.g. vgem
+};
+
+bool mapDrmDumb(struct mapping* m, size_t size);
+bool mapMemfd(struct mapping* m, size_t size);
+bool mapAny(struct mapping* m, size_t size);
+void unmapMapping(struct mapping* m);
+const char* backendName(struct mapping* m);
+// tags every following result with this mapping's backend and driver
+void resultsSetMapping(struct mapping* m);
+// aligned loads only, so it's safe on device memory
+bool mappingMatches(const void* map, const void* expected, size_t size);
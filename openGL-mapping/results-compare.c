@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "results.h"
+
+/*
+ * Compares the latest run in a results file (see results.c) against a baseline and exits with 1
+ * if anything regressed beyond the thresholds, so it can sit at the end of a script or cron job.
+ *
+ * Throughput (better = higher) regresses if it drops by more than --throughput percent,
+ * latencies (better = lower) if they rise by more than --latency percent. Counts (unit faults or
+ * count) have to rise by more than --faults in absolute numbers and by more than --counts
+ * percent, so one extra fault or deadline miss is noise, not a regression. Failures regress
+ * on any rise. Results are matched by tool, backend and name.
+ *
+ * usage: results-compare [--results file] [--baseline file | --baseline-run id] [--run id]
+ *                        [--throughput pct] [--latency pct] [--faults n] [--counts pct] [--save]
+ *
+ * --save stores the latest run (or --run) as the new baseline file instead of comparing.
+ */
+
+#define COMPARE_DEFAULT_BASELINE "baseline.jsonl"
+#define COMPARE_LINE_MAX 4096
+
+struct result {
+    char run[64];
+    char git[64];
+    char tool[64];
+    char renderer[128];
+    char kernel[128];
+    char backend[64];
+    char name[128];
+    char unit[32];
+    char better[16];
+    double value;
+    char line[COMPARE_LINE_MAX];
+};
+
+struct resultSet {
+    struct result* results;
+    size_t count;
+    size_t capacity;
+};
+
+// only handles what results.c writes: one flat object, string and number values
+static const char* parseString(const char* p, char* out, size_t outSize){
+    size_t len = 0;
+    if(*p != '"') return NULL;
+    p++;
+    while(*p && *p != '"'){
+        char c = *p++;
+        if(c == '\\'){
+            c = *p++;
+            if(c == 'u'){
+                char hex[5] = {0};
+                for(int i = 0; i < 4 && *p; i++) hex[i] = *p++;
+                c = (char)strtol(hex, NULL, 16);
+            }else if(c == 'n'){
+                c = '\n';
+            }else if(c == 't'){
+                c = '\t';
+            }else if(!c){
+                return NULL;
+            }
+        }
+        if(len + 1 < outSize){
+            out[len++] = c;
+        }
+    }
+    out[len] = 0;
+    return *p == '"' ? p + 1 : NULL;
+}
+
+static bool parseResult(const char* line, struct result* r){
+    memset(r, 0, sizeof(*r));
+    snprintf(r->line, sizeof(r->line), "%s", line);
+    bool haveValue = false;
+    const char* p = line;
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p++ != '{') return false;
+    for(;;){
+        while(*p == ' ' || *p == ',') p++;
+        if(*p == '}') break;
+        char key[32];
+        p = parseString(p, key, sizeof(key));
+        if(!p) return false;
+        while(*p == ' ') p++;
+        if(*p++ != ':') return false;
+        while(*p == ' ') p++;
+
+        if(*p == '"'){
+            char value[128];
+            p = parseString(p, value, sizeof(value));
+            if(!p) return false;
+            struct { const char* key; char* field; size_t size; } fields[] = {
+                {"run", r->run, sizeof(r->run)},
+                {"git", r->git, sizeof(r->git)},
+                {"tool", r->tool, sizeof(r->tool)},
+                {"renderer", r->renderer, sizeof(r->renderer)},
+                {"kernel", r->kernel, sizeof(r->kernel)},
+                {"backend", r->backend, sizeof(r->backend)},
+                {"name", r->name, sizeof(r->name)},
+                {"unit", r->unit, sizeof(r->unit)},
+                {"better", r->better, sizeof(r->better)},
+            };
+            for(int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++){
+                if(!strcmp(key, fields[i].key)){
+                    snprintf(fields[i].field, fields[i].size, "%s", value);
+                }
+            }
+        }else{
+            char* end;
+            double value = strtod(p, &end);
+            if(end == p) return false;
+            p = end;
+            if(!strcmp(key, "value")){
+                r->value = value;
+                haveValue = true;
+            }
+        }
+    }
+    return haveValue && r->run[0] && r->name[0];
+}
+
+static bool loadResults(const char* path, struct resultSet* set){
+    FILE* file = fopen(path, "r");
+    if(!file){
+        printf("Could not open %s\n", path);
+        return false;
+    }
+    char line[COMPARE_LINE_MAX];
+    int lineNumber = 0;
+    while(fgets(line, sizeof(line), file)){
+        lineNumber++;
+        line[strcspn(line, "\n")] = 0;
+        if(!line[0]) continue;
+        if(set->count == set->capacity){
+            set->capacity = set->capacity ? set->capacity * 2 : 256;
+            set->results = realloc(set->results, set->capacity * sizeof(struct result));
+        }
+        if(parseResult(line, &set->results[set->count])){
+            set->count++;
+        }else{
+            printf("%s:%d: skipping malformed line\n", path, lineNumber);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// the last one wins if a run recorded the same thing twice
+static const struct result* findResult(const struct resultSet* set, const char* run, const struct result* like){
+    for(size_t i = set->count; i-- > 0;){
+        const struct result* r = &set->results[i];
+        if((!run || !strcmp(r->run, run)) && !strcmp(r->tool, like->tool) &&
+           !strcmp(r->backend, like->backend) && !strcmp(r->name, like->name)){
+            return r;
+        }
+    }
+    return NULL;
+}
+
+static const struct result* firstOfRun(const struct resultSet* set, const char* run){
+    for(size_t i = 0; i < set->count; i++){
+        if(!strcmp(set->results[i].run, run)) return &set->results[i];
+    }
+    return NULL;
+}
+
+static bool isCount(const struct result* r){
+    return !strcmp(r->unit, "faults") || !strcmp(r->unit, "count");
+}
+
+int main(int argc, char** argv){
+    const char* resultsPath = getenv("MAPPING_RESULTS");
+    const char* baselinePath = COMPARE_DEFAULT_BASELINE;
+    const char* baselineRun = NULL;
+    const char* run = NULL;
+    double throughputDrop = 5.0;
+    double latencyRise = 10.0;
+    double faultRise = 2.0;
+    double countRise = 10.0;
+    bool save = false;
+
+    if(!resultsPath){
+        resultsPath = RESULTS_DEFAULT_FILE;
+    }
+    for(int i = 1; i < argc; i++){
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--results") && hasValue) resultsPath = argv[++i];
+        else if(!strcmp(argv[i], "--baseline") && hasValue) baselinePath = argv[++i];
+        else if(!strcmp(argv[i], "--baseline-run") && hasValue) baselineRun = argv[++i];
+        else if(!strcmp(argv[i], "--run") && hasValue) run = argv[++i];
+        else if(!strcmp(argv[i], "--throughput") && hasValue) throughputDrop = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--latency") && hasValue) latencyRise = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--faults") && hasValue) faultRise = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--counts") && hasValue) countRise = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--save")) save = true;
+        else{
+            printf("usage: %s [--results file] [--baseline file | --baseline-run id] [--run id]\n"
+                   "       [--throughput pct] [--latency pct] [--faults n] [--counts pct] [--save]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    struct resultSet latest = {0};
+    if(!loadResults(resultsPath, &latest)){
+        return 2;
+    }
+    if(latest.count == 0){
+        printf("No results in %s\n", resultsPath);
+        return 2;
+    }
+    if(!run){
+        run = latest.results[latest.count - 1].run;
+    }else if(!firstOfRun(&latest, run)){
+        printf("Run %s is not in %s\n", run, resultsPath);
+        return 2;
+    }
+
+    if(save){
+        FILE* file = fopen(baselinePath, "w");
+        if(!file){
+            printf("Could not write %s\n", baselinePath);
+            return 2;
+        }
+        size_t saved = 0;
+        for(size_t i = 0; i < latest.count; i++){
+            if(!strcmp(latest.results[i].run, run)){
+                fprintf(file, "%s\n", latest.results[i].line);
+                saved++;
+            }
+        }
+        fclose(file);
+        printf("Saved %zu results of run %s as the baseline in %s\n", saved, run, baselinePath);
+        return 0;
+    }
+
+    // the baseline is either another run in the same file or a saved baseline file
+    struct resultSet baseline = {0};
+    if(baselineRun){
+        if(!firstOfRun(&latest, baselineRun)){
+            printf("Run %s is not in %s\n", baselineRun, resultsPath);
+            return 2;
+        }
+        baseline = latest;
+    }else if(!loadResults(baselinePath, &baseline)){
+        printf("Save one with %s --save\n", argv[0]);
+        return 2;
+    }
+
+    const struct result* first = firstOfRun(&latest, run);
+    const struct result* firstBase = baselineRun ? firstOfRun(&baseline, baselineRun) : baseline.count ? &baseline.results[0] : NULL;
+    printf("Run      %s (git %s, %s, kernel %s)\n", run, first->git, first->renderer, first->kernel);
+    if(firstBase){
+        printf("Baseline %s (git %s, %s, kernel %s)\n", firstBase->run, firstBase->git, firstBase->renderer, firstBase->kernel);
+        if(strcmp(first->renderer, firstBase->renderer) || strcmp(first->kernel, firstBase->kernel)){
+            printf("Note: renderer or kernel differ from the baseline\n");
+        }
+    }
+    printf("\n%-12s %-14s %-40s %14s %14s %9s  %s\n", "tool", "backend", "name", "baseline", "latest", "change", "");
+
+    int regressions = 0, compared = 0, missing = 0;
+    for(size_t i = 0; i < latest.count; i++){
+        const struct result* r = &latest.results[i];
+        if(strcmp(r->run, run)) continue;
+        // skip everything but the last occurrence, that's the one findResult returns for the baseline too
+        if(findResult(&latest, run, r) != r) continue;
+
+        const struct result* base = findResult(&baseline, baselineRun, r);
+        if(!base){
+            printf("%-12s %-14s %-40s %14s %14.2f %9s  new\n", r->tool, r->backend, r->name, "-", r->value, "");
+            missing++;
+            continue;
+        }
+        compared++;
+
+        double change = base->value != 0.0 ? (r->value - base->value) / fabs(base->value) * 100.0
+                                           : (r->value == 0.0 ? 0.0 : INFINITY);
+        bool regressed;
+        if(!strcmp(r->unit, "failures")){
+            regressed = r->value > base->value;
+        }else if(isCount(r)){
+            double rise = r->value - base->value;
+            regressed = rise > faultRise && rise > fabs(base->value) * countRise / 100.0;
+        }else if(!strcmp(r->better, "higher")){
+            regressed = -change > throughputDrop;
+        }else{
+            regressed = change > latencyRise;
+        }
+        if(regressed){
+            regressions++;
+        }
+        printf("%-12s %-14s %-40s %14.2f %14.2f %+8.1f%%  %s %s\n", r->tool, r->backend, r->name,
+            base->value, r->value, change, r->unit, regressed ? "REGRESSION" : "");
+    }
+
+    printf("\n%d compared, %d without baseline, %d regressions\n", compared, missing, regressions);
+    return regressions ? 1 : 0;
+}
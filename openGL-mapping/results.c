@@ -0,0 +1,116 @@
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "results.h"
+
+/*
+ * Every benchmark number worth keeping also goes into a results file, one JSON object per line,
+ * so runs can be compared later (see results-compare.c). A line looks like
+ *
+ *   {"run":"20261019T120000-1234","git":"abc1234","tool":"mapping","renderer":"V3D 4.2",
+ *    "kernel":"6.1.0-rpi7","backend":"gl-pbo","name":"copy.write aligned","value":812.3,
+ *    "unit":"MB/s","better":"higher"}
+ *
+ * All results of one process share the run ID. The file is opened in append mode for every
+ * record, so several tools can write to the same file and nothing is lost if one crashes.
+ */
+
+static char runId[64];
+static const char* tool = "mapping";
+static char renderer[128] = "unknown";
+static char backend[64] = "unknown";
+
+void resultsSetTool(const char* name){
+    tool = name;
+}
+
+void resultsSetRenderer(const char* name){
+    snprintf(renderer, sizeof(renderer), "%s", name ? name : "unknown");
+}
+
+void resultsSetBackend(const char* name){
+    snprintf(backend, sizeof(backend), "%s", name ? name : "unknown");
+}
+
+const char* resultsRunId(){
+    if(!runId[0]){
+        time_t now = time(NULL);
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        size_t len = strftime(runId, sizeof(runId), "%Y%m%dT%H%M%S", &tm);
+        snprintf(runId + len, sizeof(runId) - len, "-%d", (int)getpid());
+    }
+    return runId;
+}
+
+// strings from drivers can contain anything, quotes and control characters have to go
+static void writeString(FILE* file, const char* key, const char* value){
+    fprintf(file, "\"%s\":\"", key);
+    for(const unsigned char* c = (const unsigned char*)value; *c; c++){
+        if(*c == '"' || *c == '\\'){
+            fprintf(file, "\\%c", *c);
+        }else if(*c < 0x20){
+            fprintf(file, "\\u%04x", *c);
+        }else{
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+void recordResult(double value, const char* unit, enum resultDirection direction, const char* nameFmt, ...){
+    if(!isfinite(value)){
+        // JSON has no inf or nan, and a broken measurement isn't worth comparing anyway
+        return;
+    }
+    const char* path = getenv("MAPPING_RESULTS");
+    if(!path){
+        path = RESULTS_DEFAULT_FILE;
+    }
+    FILE* file = fopen(path, "a");
+    if(!file){
+        // no point in spamming this for every result
+        static bool warned = false;
+        if(!warned){
+            printf("Could not open %s, results won't be recorded\n", path);
+            warned = true;
+        }
+        return;
+    }
+
+    char name[128];
+    va_list args;
+    va_start(args, nameFmt);
+    vsnprintf(name, sizeof(name), nameFmt, args);
+    va_end(args);
+
+    struct utsname uts;
+    if(uname(&uts)){
+        strcpy(uts.release, "unknown");
+    }
+
+    fputc('{', file);
+    writeString(file, "run", resultsRunId());
+    fputc(',', file);
+    writeString(file, "git", GIT_REV);
+    fputc(',', file);
+    writeString(file, "tool", tool);
+    fputc(',', file);
+    writeString(file, "renderer", renderer);
+    fputc(',', file);
+    writeString(file, "kernel", uts.release);
+    fputc(',', file);
+    writeString(file, "backend", backend);
+    fputc(',', file);
+    writeString(file, "name", name);
+    fprintf(file, ",\"value\":%.9g,", value);
+    writeString(file, "unit", unit);
+    fputc(',', file);
+    writeString(file, "better", direction == RESULT_HIGHER_BETTER ? "higher" : "lower");
+    fprintf(file, "}\n");
+    fclose(file);
+}
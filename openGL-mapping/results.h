@@ -0,0 +1,25 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// set by comp.sh
+#ifndef GIT_REV
+#define GIT_REV "unknown"
+#endif
+
+// can be overridden with the MAPPING_RESULTS environment variable
+#define RESULTS_DEFAULT_FILE "results.jsonl"
+
+enum resultDirection {
+    RESULT_HIGHER_BETTER,  // throughput
+    RESULT_LOWER_BETTER    // latency, fault counts
+};
+
+void resultsSetTool(const char* tool);
+void resultsSetRenderer(const char* renderer);
+void resultsSetBackend(const char* backend);
+const char* resultsRunId();
+// the name is a printf format, results get matched by it in results-compare
+void recordResult(double value, const char* unit, enum resultDirection direction, const char* nameFmt, ...)
+    __attribute__((format(printf, 4, 5)));
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "rt-upload.h"
+#include "copy.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Uploads a frame into the mapping at a fixed rate from a thread that gets as little
+ * interference as possible: SCHED_FIFO, pinned to one core (an isolated one if the kernel has
+ * any), all memory locked with mlockall and the mapping, every buffer and the thread's stack
+ * touched before the first deadline. What's left of the timing is the copy into device memory itself, plus
+ * whatever the scheduler still can't keep away.
+ *
+ * Every period the thread sleeps until the next deadline with clock_nanosleep and does one
+ * device_memcpy of the whole frame. For every copy it keeps how late it woke up and when the
+ * copy was done, both relative to the deadline. A copy that isn't done by the next deadline is
+ * a miss, ticks that were already over by then are skipped and counted.
+ *
+ * Without the permissions for SCHED_FIFO or mlockall (CAP_SYS_NICE, RLIMIT_RTPRIO,
+ * RLIMIT_MEMLOCK) it says so and runs anyway, the numbers are just less tight then.
+ */
+
+#define RT_UPLOAD_SECONDS 10
+#define RT_UPLOAD_PRIORITY 80
+// -1 picks the first isolated core, or the highest numbered one the process may use
+#define RT_UPLOAD_CPU -1
+#define RT_UPLOAD_PAGE 4096
+// the thread's stack, small because mlockall's MCL_FUTURE locks (and charges) all of it
+#define RT_UPLOAD_STACK (256*1024)
+// how much of it gets touched up front, the rest is headroom for libc and the copy
+#define RT_UPLOAD_STACK_TOUCH (128*1024)
+
+static const int rtUploadRates[] = {60, 120};
+
+struct rtRun {
+    void* map;
+    void* src;
+    size_t size;
+    int hz;
+    int count;
+    int cpu;
+    uint64_t* wakeup;   // ns after the deadline
+    uint64_t* done;     // ns after the deadline
+    int misses;
+    int skipped;
+    long faults;
+    bool pinned;
+    bool fifo;
+};
+
+static int pickCpu(){
+    if(RT_UPLOAD_CPU >= 0){
+        return RT_UPLOAD_CPU;
+    }
+    // e.g. "2-3,6", only the first one is needed
+    FILE* f = fopen("/sys/devices/system/cpu/isolated", "r");
+    if(f){
+        int cpu;
+        bool found = fscanf(f, "%d", &cpu) == 1;
+        fclose(f);
+        if(found){
+            return cpu;
+        }
+    }
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set)){
+        return -1;
+    }
+    for(int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--){
+        if(CPU_ISSET(cpu, &set)){
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+static uint64_t timespecNs(const struct timespec* ts){
+    return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static void addNs(struct timespec* ts, uint64_t ns){
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000ull;
+    ts->tv_nsec = ns % 1000000000ull;
+}
+
+static long threadFaults(){
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt;
+}
+
+// noinline so the array really is on this thread's stack, below everything that runs later
+static __attribute__((noinline)) void prefaultStack(){
+    volatile uint8_t touch[RT_UPLOAD_STACK_TOUCH];
+    for(size_t i = 0; i < sizeof(touch); i += RT_UPLOAD_PAGE){
+        touch[i] = 0;
+    }
+}
+
+static void* rtUploadMain(void* arg){
+    struct rtRun* run = arg;
+    prefaultStack();
+
+    // both of these are best effort, the caller reports what didn't work
+    if(run->cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(run->cpu, &set);
+        run->pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+    struct sched_param param = {.sched_priority = RT_UPLOAD_PRIORITY};
+    run->fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+    // one untimed copy, so the first deadline doesn't pay for faults or cold caches
+    device_memcpy(run->map, run->src, run->size);
+
+    uint64_t period = 1000000000ull / run->hz;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    addNs(&next, period);
+    long faults = threadFaults();
+
+    for(int i = 0; i < run->count; i++){
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+        uint64_t deadline = timespecNs(&next);
+        uint64_t wake = nowNs();
+        device_memcpy(run->map, run->src, run->size);
+        uint64_t done = nowNs();
+
+        run->wakeup[i] = wake - deadline;
+        run->done[i] = done - deadline;
+        if(done > deadline + period){
+            run->misses++;
+        }
+        addNs(&next, period);
+        while(timespecNs(&next) < done){
+            addNs(&next, period);
+            run->skipped++;
+        }
+    }
+    run->faults = threadFaults() - faults;
+    return NULL;
+}
+
+static int compareU64(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentileUs(uint64_t* sorted, int count, double percentile){
+    int index = (int)(percentile / 100.0 * (count - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+static void report(struct rtRun* run){
+    qsort(run->wakeup, run->count, sizeof(uint64_t), compareU64);
+    qsort(run->done, run->count, sizeof(uint64_t), compareU64);
+    double wakeP50 = percentileUs(run->wakeup, run->count, 50.0);
+    double wakeP99 = percentileUs(run->wakeup, run->count, 99.0);
+    double wakeMax = run->wakeup[run->count - 1] / 1000.0;
+    double doneP50 = percentileUs(run->done, run->count, 50.0);
+    double doneP99 = percentileUs(run->done, run->count, 99.0);
+    double doneMax = run->done[run->count - 1] / 1000.0;
+
+    printf("%d Hz, %d copies (budget %.1f us):\n", run->hz, run->count, 1e6 / run->hz);
+    printf("  wakeup late by     p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", wakeP50, wakeP99, wakeMax);
+    printf("  copy done after    p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", doneP50, doneP99, doneMax);
+    printf("  jitter (p99 - p50) %.1f us, worst case %.1f us over the median\n", doneP99 - doneP50, doneMax - doneP50);
+    printf("  %d deadline misses, %d ticks skipped, %ld page faults while running\n", run->misses, run->skipped, run->faults);
+
+    recordResult(wakeP99, "us", RESULT_LOWER_BETTER, "rt.%dHz wakeup p99", run->hz);
+    recordResult(doneP50, "us", RESULT_LOWER_BETTER, "rt.%dHz completion p50", run->hz);
+    recordResult(doneP99, "us", RESULT_LOWER_BETTER, "rt.%dHz completion p99", run->hz);
+    recordResult(doneMax, "us", RESULT_LOWER_BETTER, "rt.%dHz completion max", run->hz);
+    recordResult(run->misses, "count", RESULT_LOWER_BETTER, "rt.%dHz deadline misses", run->hz);
+}
+
+void runRtUpload(void* map, size_t size){
+    int cpu = pickCpu();
+    printf("Real-time upload: 0x%zx bytes per frame into %p, %d s per rate, CPU %d\n", size, map, RT_UPLOAD_SECONDS, cpu);
+
+    int maxCount = 0;
+    for(int r = 0; r < sizeof(rtUploadRates) / sizeof(rtUploadRates[0]); r++){
+        if(rtUploadRates[r] * RT_UPLOAD_SECONDS > maxCount){
+            maxCount = rtUploadRates[r] * RT_UPLOAD_SECONDS;
+        }
+    }
+    // touched before mlockall, so everything is resident when it gets locked
+    void* src = aligned_alloc(RT_UPLOAD_PAGE, (size + RT_UPLOAD_PAGE - 1) & ~(size_t)(RT_UPLOAD_PAGE - 1));
+    uint64_t* wakeup = malloc(maxCount * sizeof(uint64_t));
+    uint64_t* done = malloc(maxCount * sizeof(uint64_t));
+    if(!src || !wakeup || !done){
+        printf("Out of memory\n");
+        free(src);
+        free(wakeup);
+        free(done);
+        return;
+    }
+    for(size_t i = 0; i < size; i++){
+        ((uint8_t*)src)[i] = i * 13 + (i >> 12);
+    }
+    memset(wakeup, 0, maxCount * sizeof(uint64_t));
+    memset(done, 0, maxCount * sizeof(uint64_t));
+    // every page of the mapping gets one aligned store, device memory may not like anything else
+    for(size_t pos = 0; pos + 8 <= size; pos += RT_UPLOAD_PAGE){
+        *(volatile uint64_t*)(map + pos) = 0;
+    }
+
+    bool locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    if(!locked){
+        printf("mlockall failed (%s), page faults can hit the copies\n", strerror(errno));
+    }
+
+    for(int r = 0; r < sizeof(rtUploadRates) / sizeof(rtUploadRates[0]); r++){
+        struct rtRun run = {
+            .map = map,
+            .src = src,
+            .size = size,
+            .hz = rtUploadRates[r],
+            .count = rtUploadRates[r] * RT_UPLOAD_SECONDS,
+            .cpu = cpu,
+            .wakeup = wakeup,
+            .done = done,
+        };
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, RT_UPLOAD_STACK);
+        int err = pthread_create(&thread, &attr, rtUploadMain, &run);
+        if(err && locked){
+            // the locked stack went over RLIMIT_MEMLOCK, run unlocked instead of not at all
+            printf("Could not start the upload thread with memory locked (%s), unlocking\n", strerror(err));
+            munlockall();
+            locked = false;
+            err = pthread_create(&thread, &attr, rtUploadMain, &run);
+        }
+        pthread_attr_destroy(&attr);
+        if(err){
+            printf("Could not start the upload thread (%s)\n", strerror(err));
+            break;
+        }
+        pthread_join(thread, NULL);
+
+        if(cpu >= 0 && !run.pinned){
+            printf("Could not pin the upload thread to CPU %d\n", cpu);
+        }
+        if(!run.fifo){
+            printf("No SCHED_FIFO (needs CAP_SYS_NICE or RLIMIT_RTPRIO), ran at normal priority\n");
+        }
+        report(&run);
+    }
+
+    if(locked){
+        munlockall();
+    }
+    free(src);
+    free(wakeup);
+    free(done);
+}
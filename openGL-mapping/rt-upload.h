@@ -0,0 +1,7 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// map has to stay mapped and writable for the whole run, size bytes get copied every frame
+void runRtUpload(void* map, size_t size);
@@ -0,0 +1,118 @@
+#include "scaling.h"
+#include "copy.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Allocates pixel unpack buffers from 4KB up to 256MB with the same storage and mapping flags
+ * the main test uses, and times every step of getting data into them:
+ * glBufferStorage, glMapBufferRange, touching every page once, copying the whole buffer
+ * (aligned and offset by one like the main test does) and glUnmapBuffer.
+ */
+
+#define SCALING_MIN_SIZE (4*1024)
+#define SCALING_MAX_SIZE (256*1024*1024)
+#define SCALING_STEP 4
+// every size gets copied repeatedly until at least this much data went through
+#define SCALING_COPY_BYTES (64*1024*1024)
+#define SCALING_PAGE_SIZE 4096
+
+#define SCALING_STORAGE_FLAGS (GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_COHERENT_BIT | GL_MAP_PERSISTENT_BIT)
+#define SCALING_MAP_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static double usSince(uint64_t start){
+    return (double)(nowNs() - start) / 1000.0;
+}
+
+// returns false if the buffer couldn't be created, larger ones won't work either then
+static bool scaleOne(size_t size, void* src){
+    GLuint buffer;
+    GLenum err;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glFinish();
+
+    uint64_t start = nowNs();
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, SCALING_STORAGE_FLAGS);
+    glFinish();
+    double storageUs = usSince(start);
+    err = glGetError();
+    if(err != GL_NO_ERROR){
+        printf("%10zu  glBufferStorage failed (err: %d)\n", size, err);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return false;
+    }
+
+    start = nowNs();
+    void* buf = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, SCALING_MAP_FLAGS);
+    double mapUs = usSince(start);
+    if(!buf){
+        printf("%10zu  glMapBufferRange failed (err: %d)\n", size, glGetError());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return false;
+    }
+
+    // first touch: one aligned store per page, so this is mostly fault handling
+    long faults = minorFaults();
+    start = nowNs();
+    for(size_t pos = 0; pos < size; pos += SCALING_PAGE_SIZE){
+        *(volatile uint64_t*)(buf + pos) = pos;
+    }
+    double touchUs = usSince(start);
+    faults = minorFaults() - faults;
+
+    int reps = SCALING_COPY_BYTES / size;
+    if(reps < 1) reps = 1;
+
+    start = nowNs();
+    for(int i = 0; i < reps; i++){
+        this_memcpy_quiet(buf, src, size);
+    }
+    double alignedMBs = mbPerSec(size * reps, nowNs() - start);
+
+    // offset by one like the main test, to get the fixup path involved
+    start = nowNs();
+    for(int i = 0; i < reps; i++){
+        this_memcpy_quiet(buf + 1, src + 1, size - 1);
+    }
+    double unalignedMBs = mbPerSec((size - 1) * reps, nowNs() - start);
+
+    start = nowNs();
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glFinish();
+    double unmapUs = usSince(start);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    printf("%10zu %12.1f %10.1f %12.1f %8ld %12.1f %12.1f %10.1f\n",
+        size, storageUs, mapUs, touchUs, faults, alignedMBs, unalignedMBs, unmapUs);
+    recordResult(mapUs, "us", RESULT_LOWER_BETTER, "scaling.%zu map", size);
+    recordResult(touchUs, "us", RESULT_LOWER_BETTER, "scaling.%zu first touch", size);
+    recordResult(alignedMBs, "MB/s", RESULT_HIGHER_BETTER, "scaling.%zu write aligned", size);
+    recordResult(unalignedMBs, "MB/s", RESULT_HIGHER_BETTER, "scaling.%zu write offset 1", size);
+    return true;
+}
+
+void runScalingTest(){
+    printf("\nMapping size scaling:\n");
+    printf("%10s %12s %10s %12s %8s %12s %12s %10s\n",
+        "bytes", "storage us", "map us", "touch us", "faults", "copy MB/s", "copy+1 MB/s", "unmap us");
+
+    void* src = malloc(SCALING_MAX_SIZE);
+    if(!src){
+        printf("Could not allocate the source buffer\n");
+        return;
+    }
+    memset(src, 128, SCALING_MAX_SIZE);
+
+    for(size_t size = SCALING_MIN_SIZE; size <= SCALING_MAX_SIZE; size *= SCALING_STEP){
+        if(!scaleOne(size, src)){
+            break;
+        }
+    }
+
+    free(src);
+}
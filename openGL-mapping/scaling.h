@@ -0,0 +1,7 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+void runScalingTest();
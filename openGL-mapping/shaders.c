@@ -0,0 +1,85 @@
+#include "shaders.h"
+
+GLuint compileShader(const char* src,GLuint type){
+    GLuint shader;
+    GLuint i = glGetError();
+    shader = glCreateShader(type);
+    i = glGetError();
+    glShaderSource(shader,1,&src,NULL);
+    i = glGetError();
+    glCompileShader(shader);
+    i = glGetError();
+    int success;
+    glGetShaderiv(shader,GL_COMPILE_STATUS,&success);
+    i = glGetError();
+    printf("Creating shader\n");
+    if(!success){
+        GLuint len;
+        i = glGetError();
+        glGetShaderiv(shader,GL_INFO_LOG_LENGTH,&len);
+        i = glGetError();
+        char* buf = (char*)malloc(len+1);
+        glGetShaderInfoLog(shader,len,NULL,buf);
+        i = glGetError();
+        printf("Shader compiling failed:\n%s\n",buf);
+        free(buf);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint compileProgram(const char* vtx, const char* frg){
+    GLuint vertex = compileShader(vtx,GL_VERTEX_SHADER);
+    GLuint fragment = compileShader(frg,GL_FRAGMENT_SHADER);
+    if(vertex == 0 || fragment == 0){
+        // one of the shaders failed to compile
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program,vertex);
+    glAttachShader(program,fragment);
+    glLinkProgram(program);
+
+    int success;
+    glGetProgramiv(program,GL_LINK_STATUS,&success);
+    if(!success){
+        GLuint len;
+        glGetProgramiv(program,GL_INFO_LOG_LENGTH,&len);
+        char* buf = (char*)malloc(len+1);
+        glGetProgramInfoLog(program,len,NULL,buf);
+        printf("Shader linking failed:\n%s\n",buf);
+        free(buf);
+        return 0;
+    }
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    printf("Linked Program %d\n",program);
+    return program;
+}
+
+GLuint compileComputeProgram(const char* src){
+    GLuint compute = compileShader(src,GL_COMPUTE_SHADER);
+    if(compute == 0){
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program,compute);
+    glLinkProgram(program);
+
+    int success;
+    glGetProgramiv(program,GL_LINK_STATUS,&success);
+    if(!success){
+        GLuint len;
+        glGetProgramiv(program,GL_INFO_LOG_LENGTH,&len);
+        char* buf = (char*)malloc(len+1);
+        glGetProgramInfoLog(program,len,NULL,buf);
+        printf("Compute shader linking failed:\n%s\n",buf);
+        free(buf);
+        return 0;
+    }
+    glDeleteShader(compute);
+    printf("Linked compute Program %d\n",program);
+    return program;
+}
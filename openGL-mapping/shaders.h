@@ -0,0 +1,7 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+GLuint compileShader(const char* src,GLuint type);
+GLuint compileProgram(const char* vtx, const char* frg);
+GLuint compileComputeProgram(const char* src);
@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "soak.h"
+#include "copy.h"
+#include "bench.h"
+#include "gpu-verify.h"
+#include "results.h"
+
+/*
+ * Runs the main test's write -> flush -> upload (-> readback) sequence over and over for a long
+ * time, to catch the rare hitches a single copy never shows: fixup storms, driver stalls,
+ * compaction, whatever else the kernel decides to do in between.
+ *
+ * The GL thread only times the phases and pushes one sample per iteration into a single
+ * producer / single consumer ring, it never prints or allocates. A second thread drains the
+ * ring into a log-linear (HDR style) histogram, prints percentiles every SOAK_REPORT_SECONDS
+ * and flags every iteration that took longer than SOAK_SPIKE_FACTOR times the current median,
+ * together with the fault counters and what else was going on around it.
+ *
+ * If the ring is full the sample is dropped and counted, the GL thread never waits on the
+ * reporter. Closing the window stops the soak early.
+ */
+
+#define SOAK_WIDTH 1280
+#define SOAK_HEIGHT 720
+#define SOAK_FRAME_SIZE (SOAK_WIDTH*SOAK_HEIGHT*4)
+
+#define SOAK_SECONDS (60*60)
+#define SOAK_REPORT_SECONDS 60
+#define SOAK_SPIKE_FACTOR 4
+// the median isn't worth much before that
+#define SOAK_WARMUP_SAMPLES 1000
+// copy the frame back out of the mapping and compare it every iteration
+#define SOAK_READBACK 1
+// hash the texture on the GPU every n iterations, 0 to turn it off
+#define SOAK_VERIFY_EVERY 0
+// present every n iterations so the window stays alive, not part of the timed sequence
+#define SOAK_PRESENT_EVERY 16
+
+#define SOAK_RING_SIZE 4096 // power of two
+
+#define SOAK_STORAGE_FLAGS (GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT)
+#define SOAK_MAP_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT)
+
+/*
+ * Histogram with 128 buckets below 128, then 64 linear sub-buckets per power of two, so every
+ * value is within 1/64 of its bucket's lower bound. Values are in ns, anything above 2^40 (18 minutes) ends up in the
+ * last bucket.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)
+#define HIST_MAX_SHIFT (40 - HIST_SUB_BITS + 1)
+#define HIST_BUCKETS (HIST_SUB_COUNT + HIST_MAX_SHIFT * HIST_HALF_COUNT)
+
+struct soakSample {
+    uint64_t iteration;
+    uint64_t startNs;   // relative to the start of the soak
+    uint64_t totalNs;
+    uint64_t writeNs;
+    uint64_t flushNs;
+    uint64_t uploadNs;
+    uint64_t readbackNs;
+    long minorFaults;
+    long alignmentFaults;   // -1 if the counter isn't available
+    long involuntarySwitches;
+    int cpu;
+    bool mismatch;
+};
+
+struct soakRing {
+    _Atomic uint64_t head; // written by the GL thread only
+    _Atomic uint64_t tail; // written by the reporter only
+    _Atomic uint64_t dropped;
+    _Atomic bool done;
+    struct soakSample samples[SOAK_RING_SIZE];
+};
+
+struct histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+struct soakReporter {
+    struct soakRing* ring;
+    struct histogram all;
+    struct histogram interval;
+    uint64_t median;
+    uint64_t spikes;
+    uint64_t mismatches;
+    uint64_t lastReportNs;
+    struct soakSample previous;
+};
+
+static int histIndex(uint64_t value){
+    if(value < HIST_SUB_COUNT){
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - (HIST_SUB_BITS - 1);
+    if(shift > HIST_MAX_SHIFT){
+        return HIST_BUCKETS - 1;
+    }
+    return HIST_SUB_COUNT + (shift - 1) * HIST_HALF_COUNT + (int)(value >> shift) - HIST_HALF_COUNT;
+}
+
+static uint64_t histValue(int index){
+    if(index < HIST_SUB_COUNT){
+        return index;
+    }
+    int shift = (index - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+    uint64_t sub = (index - HIST_SUB_COUNT) % HIST_HALF_COUNT + HIST_HALF_COUNT;
+    return sub << shift;
+}
+
+static void histAdd(struct histogram* hist, uint64_t value){
+    hist->counts[histIndex(value)]++;
+    hist->total++;
+    if(value > hist->max){
+        hist->max = value;
+    }
+}
+
+// lower bound of the bucket the given percentile falls into
+static uint64_t histPercentile(const struct histogram* hist, double percentile){
+    if(hist->total == 0){
+        return 0;
+    }
+    uint64_t wanted = (uint64_t)(hist->total * percentile / 100.0);
+    if(wanted >= hist->total){
+        wanted = hist->total - 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < HIST_BUCKETS; i++){
+        seen += hist->counts[i];
+        if(seen > wanted){
+            return histValue(i);
+        }
+    }
+    return hist->max;
+}
+
+static void printPercentiles(const char* name, const struct histogram* hist){
+    printf("%-9s %10lu samples  p50 %8.1fus  p90 %8.1fus  p99 %8.1fus  p99.9 %8.1fus  p99.99 %8.1fus  max %8.1fus\n",
+        name, hist->total,
+        histPercentile(hist, 50.0) / 1000.0, histPercentile(hist, 90.0) / 1000.0,
+        histPercentile(hist, 99.0) / 1000.0, histPercentile(hist, 99.9) / 1000.0,
+        histPercentile(hist, 99.99) / 1000.0, hist->max / 1000.0);
+}
+
+static void printSpike(const struct soakSample* sample, const struct soakSample* previous, uint64_t median){
+    printf("SPIKE at %9.3fs iteration %lu: %.1fus (%.1fx median %.1fus) cpu %d\n",
+        sample->startNs / 1e9, sample->iteration, sample->totalNs / 1000.0,
+        (double)sample->totalNs / median, median / 1000.0, sample->cpu);
+    printf("      write %.1fus  flush %.1fus  upload %.1fus  readback %.1fus\n",
+        sample->writeNs / 1000.0, sample->flushNs / 1000.0,
+        sample->uploadNs / 1000.0, sample->readbackNs / 1000.0);
+    printf("      minor faults %ld  alignment faults %ld  involuntary switches %ld  (previous iteration %.1fus on cpu %d)\n",
+        sample->minorFaults, sample->alignmentFaults, sample->involuntarySwitches,
+        previous->totalNs / 1000.0, previous->cpu);
+}
+
+static void reportInterval(struct soakReporter* reporter, uint64_t now){
+    printf("--- %.0fs, %lu spikes, %lu dropped samples, %lu mismatches\n",
+        now / 1e9, reporter->spikes, atomic_load(&reporter->ring->dropped), reporter->mismatches);
+    printPercentiles("interval", &reporter->interval);
+    printPercentiles("total", &reporter->all);
+    memset(&reporter->interval, 0, sizeof(reporter->interval));
+}
+
+static void reporterTake(struct soakReporter* reporter, const struct soakSample* sample){
+    histAdd(&reporter->all, sample->totalNs);
+    histAdd(&reporter->interval, sample->totalNs);
+
+    // walking the histogram isn't free, the median doesn't move that fast anyway
+    if((reporter->all.total & 255) == 0){
+        reporter->median = histPercentile(&reporter->all, 50.0);
+    }
+    if(reporter->all.total > SOAK_WARMUP_SAMPLES && reporter->median &&
+       sample->totalNs > reporter->median * SOAK_SPIKE_FACTOR){
+        reporter->spikes++;
+        printSpike(sample, &reporter->previous, reporter->median);
+    }
+    if(sample->mismatch){
+        reporter->mismatches++;
+        printf("MISMATCH at %9.3fs iteration %lu: data doesn't match what was written\n",
+            sample->startNs / 1e9, sample->iteration);
+    }
+    reporter->previous = *sample;
+
+    if(sample->startNs - reporter->lastReportNs >= (uint64_t)SOAK_REPORT_SECONDS * 1000000000ull){
+        reporter->lastReportNs = sample->startNs;
+        reportInterval(reporter, sample->startNs);
+    }
+}
+
+static void* soakReporterMain(void* arg){
+    struct soakReporter* reporter = arg;
+    struct soakRing* ring = reporter->ring;
+    struct timespec idle = {0, 1000000};
+
+    for(;;){
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if(tail == head){
+            // done has to be checked before head, otherwise the last samples could get lost
+            if(atomic_load(&ring->done) && tail == atomic_load(&ring->head)){
+                break;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        for(; tail != head; tail++){
+            reporterTake(reporter, &ring->samples[tail & (SOAK_RING_SIZE - 1)]);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+static void soakPush(struct soakRing* ring, const struct soakSample* sample){
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if(head - tail >= SOAK_RING_SIZE){
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring->samples[head & (SOAK_RING_SIZE - 1)] = *sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static long involuntarySwitches(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nivcsw;
+}
+
+static void drawFrame(GLFWwindow* window, GLuint prog, GLuint vao, GLuint tex){
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindVertexArray(vao);
+    glUseProgram(prog);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glfwSwapBuffers(window);
+    glfwPollEvents();
+}
+
+void runSoakTest(GLFWwindow* window, GLuint prog, GLuint vao){
+    printf("\nSoak test: %dx%d frames for %ds, spikes above %dx the median\n",
+        SOAK_WIDTH, SOAK_HEIGHT, SOAK_SECONDS, SOAK_SPIKE_FACTOR);
+
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, SOAK_FRAME_SIZE, NULL, SOAK_STORAGE_FLAGS);
+    void* map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, SOAK_FRAME_SIZE, SOAK_MAP_FLAGS);
+    if(!map){
+        printf("Could not map the soak buffer (err: %d)\n", glGetError());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return;
+    }
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, SOAK_WIDTH, SOAK_HEIGHT);
+
+    // two source frames, so every iteration actually changes the data
+    uint8_t* src[2];
+    uint8_t* back = malloc(SOAK_FRAME_SIZE);
+    for(int f = 0; f < 2; f++){
+        src[f] = malloc(SOAK_FRAME_SIZE);
+        for(size_t i = 0; i < SOAK_FRAME_SIZE; i++){
+            src[f][i] = (i * 7 + f * 101) & 0xff;
+        }
+    }
+
+    struct soakRing* ring = calloc(1, sizeof(*ring));
+    struct soakReporter* reporter = calloc(1, sizeof(*reporter));
+    reporter->ring = ring;
+    pthread_t reporterThread;
+    if(pthread_create(&reporterThread, NULL, soakReporterMain, reporter)){
+        printf("Could not start the reporter thread\n");
+        goto cleanup;
+    }
+
+    uint64_t start = nowNs();
+    uint64_t end = start + (uint64_t)SOAK_SECONDS * 1000000000ull;
+    long faults = minorFaults();
+    long alignFaults = alignmentFaults();
+    long switches = involuntarySwitches();
+
+    for(uint64_t iteration = 0; !glfwWindowShouldClose(window); iteration++){
+        struct soakSample sample = {0};
+        uint8_t* frame = src[iteration & 1];
+        uint64_t t0 = nowNs();
+        if(t0 >= end){
+            break;
+        }
+        sample.iteration = iteration;
+        sample.startNs = t0 - start;
+        sample.cpu = sched_getcpu();
+
+        // offset by 1 like the main test, that's where the fixups happen
+        this_memcpy_quiet(map + 1, frame + 1, SOAK_FRAME_SIZE - 1);
+        uint64_t t1 = nowNs();
+
+        glFlushMappedBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, SOAK_FRAME_SIZE);
+        uint64_t t2 = nowNs();
+
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SOAK_WIDTH, SOAK_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // a stall past the timeout just shows up as an enormous upload time, that's what this is looking for
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fence);
+        uint64_t t3 = nowNs();
+
+#if SOAK_READBACK==1
+        this_memcpy_quiet(back + 1, map + 1, SOAK_FRAME_SIZE - 1);
+        if(memcmp(back + 1, frame + 1, SOAK_FRAME_SIZE - 1)){
+            sample.mismatch = true;
+        }
+#endif
+        uint64_t t4 = nowNs();
+
+        sample.writeNs = t1 - t0;
+        sample.flushNs = t2 - t1;
+        sample.uploadNs = t3 - t2;
+        sample.readbackNs = t4 - t3;
+        sample.totalNs = t4 - t0;
+
+        long nowFaults = minorFaults();
+        long nowAlign = alignmentFaults();
+        long nowSwitches = involuntarySwitches();
+        sample.minorFaults = nowFaults - faults;
+        sample.alignmentFaults = nowAlign < 0 ? -1 : nowAlign - alignFaults;
+        sample.involuntarySwitches = nowSwitches - switches;
+        faults = nowFaults;
+        alignFaults = nowAlign;
+        switches = nowSwitches;
+
+#if SOAK_VERIFY_EVERY > 0
+        if(iteration % SOAK_VERIFY_EVERY == 0 && !gpuVerifyTexture(tex, SOAK_WIDTH, 1, SOAK_HEIGHT - 1, frame + SOAK_WIDTH * 4)){
+            sample.mismatch = true;
+        }
+#endif
+        soakPush(ring, &sample);
+
+        if(iteration % SOAK_PRESENT_EVERY == 0){
+            drawFrame(window, prog, vao, tex);
+        }
+    }
+
+    atomic_store(&ring->done, true);
+    pthread_join(reporterThread, NULL);
+    reportInterval(reporter, nowNs() - start);
+
+    struct histogram* all = &reporter->all;
+    recordResult(histPercentile(all, 50.0) / 1000.0, "us", RESULT_LOWER_BETTER, "soak.p50");
+    recordResult(histPercentile(all, 99.0) / 1000.0, "us", RESULT_LOWER_BETTER, "soak.p99");
+    recordResult(histPercentile(all, 99.9) / 1000.0, "us", RESULT_LOWER_BETTER, "soak.p99.9");
+    recordResult(all->max / 1000.0, "us", RESULT_LOWER_BETTER, "soak.max");
+    recordResult(reporter->spikes, "count", RESULT_LOWER_BETTER, "soak.spikes");
+    recordResult(reporter->mismatches, "failures", RESULT_LOWER_BETTER, "soak.mismatches");
+
+cleanup:
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    glDeleteTextures(1, &tex);
+    free(ring);
+    free(reporter);
+    free(src[0]);
+    free(src[1]);
+    free(back);
+}
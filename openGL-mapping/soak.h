@@ -0,0 +1,8 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+void runSoakTest(GLFWwindow* window, GLuint prog, GLuint vao);
@@ -0,0 +1,302 @@
+#include "stream-ring.h"
+#include "copy.h"
+#include "bench.h"
+#include "shaders.h"
+#include "results.h"
+
+/*
+ * Persistently mapped buffer that small per-draw data (vertices, uniform blocks) gets
+ * sub-allocated from. The buffer is split into one segment per frame in flight, a frame only
+ * allocates from its own segment and puts a fence behind its draws at the end, so a segment
+ * only gets reused once the GPU is done with everything that was in it.
+ *
+ * Allocations are aligned (at least 16 bytes), so the writes into the mapping can use the
+ * fixed size copies from copy.c, which only do aligned stores.
+ *
+ * runStreamRingTest compares draws per second with this against a glBufferData call per draw,
+ * which is what the main test does for its one quad.
+ */
+
+#define STREAM_STORAGE_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+#define STREAM_MAP_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+#define STREAM_MIN_ALIGN 16
+
+#define STREAM_RING_SIZE (16*1024*1024)
+#define STREAM_DRAWS_PER_FRAME 2000
+#define STREAM_FRAMES 50
+#define STREAM_VERTEX_SIZE 80   // the 4 vertex quad from main.c
+#define STREAM_UNIFORM_SIZE 64
+
+bool streamRingInit(struct streamRing* ring, size_t size){
+    memset(ring, 0, sizeof(*ring));
+    ring->size = size;
+    ring->segmentSize = size / STREAM_RING_FRAMES / STREAM_MIN_ALIGN * STREAM_MIN_ALIGN;
+
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, STREAM_STORAGE_FLAGS);
+    ring->map = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, STREAM_MAP_FLAGS);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if(!ring->map){
+        printf("Could not map the stream ring (err: %d)\n", glGetError());
+        glDeleteBuffers(1, &ring->buffer);
+        ring->buffer = 0;
+        return false;
+    }
+    return true;
+}
+
+// waits until the GPU is done with the segment this frame is going to use
+void streamRingBeginFrame(struct streamRing* ring){
+    GLsync fence = ring->fences[ring->frame];
+    if(fence){
+        GLenum wait;
+        do{
+            wait = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        }while(wait == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        ring->fences[ring->frame] = 0;
+    }
+    ring->head = ring->frame * ring->segmentSize;
+}
+
+// NULL if the segment is full, align has to be a power of two
+void* streamRingAlloc(struct streamRing* ring, size_t size, size_t align, GLintptr* offset){
+    if(align < STREAM_MIN_ALIGN){
+        align = STREAM_MIN_ALIGN;
+    }
+    size_t start = (ring->head + align - 1) & ~(align - 1);
+    if(start + size > (ring->frame + 1) * ring->segmentSize){
+        return NULL;
+    }
+    ring->head = start + size;
+    *offset = start;
+    return ring->map + start;
+}
+
+bool streamRingWrite(struct streamRing* ring, const void* data, size_t size, size_t align, GLintptr* offset){
+    void* dst = streamRingAlloc(ring, size, align, offset);
+    if(!dst){
+        return false;
+    }
+    small_memcpy(dst, data, size);
+    return true;
+}
+
+void streamRingEndFrame(struct streamRing* ring){
+    ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring->frame = (ring->frame + 1) % STREAM_RING_FRAMES;
+}
+
+void streamRingDestroy(struct streamRing* ring){
+    for(int i = 0; i < STREAM_RING_FRAMES; i++){
+        if(ring->fences[i]){
+            glClientWaitSync(ring->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            glDeleteSync(ring->fences[i]);
+        }
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &ring->buffer);
+    memset(ring, 0, sizeof(*ring));
+}
+
+const char* streamVtx_Shader =
+"#version 330\n"
+"layout (location = 0) in vec3 pos;\n"
+"layout (location = 1) in vec2 tex;\n"
+"layout (std140) uniform DrawBlock { vec4 offset; vec4 colour; vec4 unused[2]; } draw;\n"
+"out vec4 col;\n"
+"void main(){\n"
+"gl_Position = vec4(pos.xy + draw.offset.xy, pos.z, 1.0f);\n"
+"col = draw.colour * vec4(tex, 1.0f, 1.0f);\n"
+"}";
+
+const char* streamFrg_Shader =
+"#version 330\n"
+"in vec4 col;\n"
+"out vec4 colour;\n"
+"void main(){\n"
+"colour = col;\n"
+"}";
+
+enum streamPath {
+    STREAM_BUFFER_DATA,  // glBufferData for every draw
+    STREAM_RING          // sub-allocated from the ring
+};
+
+struct streamBench {
+    GLuint prog;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ubo;
+    GLint uniformAlign;
+    struct streamRing ring;
+    float (*verts)[STREAM_VERTEX_SIZE / 4];
+    float (*uniforms)[STREAM_UNIFORM_SIZE / 4];
+};
+
+// returns the draws that didn't fit into the ring
+static long streamFrame(struct streamBench* bench, enum streamPath path, void* (*copy)(void*, const void*, size_t)){
+    long overflows = 0;
+    if(path == STREAM_RING){
+        streamRingBeginFrame(&bench->ring);
+    }
+    for(int d = 0; d < STREAM_DRAWS_PER_FRAME; d++){
+        if(path == STREAM_BUFFER_DATA){
+            glBindBuffer(GL_ARRAY_BUFFER, bench->vbo);
+            glBufferData(GL_ARRAY_BUFFER, STREAM_VERTEX_SIZE, bench->verts[d], GL_STREAM_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, bench->ubo);
+            glBufferData(GL_UNIFORM_BUFFER, STREAM_UNIFORM_SIZE, bench->uniforms[d], GL_STREAM_DRAW);
+            glBindVertexBuffer(0, bench->vbo, 0, 20);
+            glBindBufferBase(GL_UNIFORM_BUFFER, 0, bench->ubo);
+        }else{
+            GLintptr vtxOffset, uniOffset;
+            void* vtx = streamRingAlloc(&bench->ring, STREAM_VERTEX_SIZE, STREAM_MIN_ALIGN, &vtxOffset);
+            void* uni = streamRingAlloc(&bench->ring, STREAM_UNIFORM_SIZE, bench->uniformAlign, &uniOffset);
+            if(!vtx || !uni){
+                overflows++;
+                continue;
+            }
+            copy(vtx, bench->verts[d], STREAM_VERTEX_SIZE);
+            copy(uni, bench->uniforms[d], STREAM_UNIFORM_SIZE);
+            glBindVertexBuffer(0, bench->ring.buffer, vtxOffset, 20);
+            glBindBufferRange(GL_UNIFORM_BUFFER, 0, bench->ring.buffer, uniOffset, STREAM_UNIFORM_SIZE);
+        }
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    if(path == STREAM_RING){
+        streamRingEndFrame(&bench->ring);
+    }
+    return overflows;
+}
+
+static void streamRun(struct streamBench* bench, const char* name, enum streamPath path, void* (*copy)(void*, const void*, size_t)){
+    // one frame to get everything allocated and compiled
+    streamFrame(bench, path, copy);
+    glFinish();
+
+    long overflows = 0;
+    long faults = alignmentFaults();
+    uint64_t start = nowNs();
+    for(int f = 0; f < STREAM_FRAMES; f++){
+        overflows += streamFrame(bench, path, copy);
+    }
+    glFinish();
+    uint64_t ns = nowNs() - start;
+    long afterFaults = alignmentFaults();
+
+    double draws = (double)STREAM_FRAMES * STREAM_DRAWS_PER_FRAME;
+    printf("%-26s %12.0f draws/s  %8.1f frames/s  %6.2f us/draw",
+        name, draws / (ns / 1e9), STREAM_FRAMES / (ns / 1e9), ns / 1000.0 / draws);
+    if(faults >= 0){
+        printf("  %ld alignment faults", afterFaults - faults);
+    }
+    if(overflows){
+        printf("  (%ld draws didn't fit)", overflows);
+    }
+    printf("\n");
+    recordResult(draws / (ns / 1e9), "draws/s", RESULT_HIGHER_BETTER, "stream.%s", name);
+}
+
+// ns per copy of every fixed size into the mapping, slot aligned like the ring hands them out
+static void streamCopyBench(struct streamRing* ring){
+    const size_t sizes[] = {16, 32, 64, 80, 128};
+    const int reps = 100000;
+    char src[128 + 1];
+    for(int i = 0; i < sizeof(src); i++){
+        src[i] = i;
+    }
+
+    printf("%6s %14s %14s %14s\n", "size", "small_memcpy", "this_memcpy", "libc memcpy");
+    for(int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        size_t n = sizes[s];
+        void* (*copies[])(void*, const void*, size_t) = {small_memcpy, this_memcpy_quiet, memcpy};
+        printf("%6zu", n);
+        for(int c = 0; c < 3; c++){
+            uint64_t start = nowNs();
+            for(int r = 0; r < reps; r++){
+                // walk through the first segment, so it isn't always the same cache line
+                copies[c](ring->map + (r * 128) % ring->segmentSize, src + 1, n);
+            }
+            printf(" %12.1fns", (double)(nowNs() - start) / reps);
+        }
+        printf("\n");
+    }
+}
+
+void runStreamRingTest(){
+    if(!GLEW_ARB_vertex_attrib_binding){
+        printf("\nStream ring test needs ARB_vertex_attrib_binding\n");
+        return;
+    }
+    printf("\nStreaming ring: %d draws per frame, %d frames, %d byte vertices + %d byte uniform block per draw\n",
+        STREAM_DRAWS_PER_FRAME, STREAM_FRAMES, STREAM_VERTEX_SIZE, STREAM_UNIFORM_SIZE);
+
+    struct streamBench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.prog = compileProgram(streamVtx_Shader, streamFrg_Shader);
+    if(bench.prog == 0){
+        return;
+    }
+    glUniformBlockBinding(bench.prog, glGetUniformBlockIndex(bench.prog, "DrawBlock"), 0);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &bench.uniformAlign);
+
+    if(!streamRingInit(&bench.ring, STREAM_RING_SIZE)){
+        glDeleteProgram(bench.prog);
+        return;
+    }
+
+    // a small quad per draw, spread over the viewport
+    bench.verts = malloc(STREAM_DRAWS_PER_FRAME * STREAM_VERTEX_SIZE);
+    bench.uniforms = malloc(STREAM_DRAWS_PER_FRAME * STREAM_UNIFORM_SIZE);
+    for(int d = 0; d < STREAM_DRAWS_PER_FRAME; d++){
+        float quad[] = {-0.01f,0.01f,0.0f, 0.0f,1.0f,
+                        0.01f,0.01f,0.0f,  1.0f,1.0f,
+                        -0.01f,-0.01f,0.0f,0.0f,0.0f,
+                        0.01f,-0.01f,0.0f, 1.0f,0.0f,  };
+        memcpy(bench.verts[d], quad, sizeof(quad));
+        float* u = bench.uniforms[d];
+        memset(u, 0, STREAM_UNIFORM_SIZE);
+        u[0] = (d % 50) / 25.0f - 1.0f;
+        u[1] = (d / 50) / 20.0f - 1.0f;
+        u[4] = 0.1f;
+        u[5] = (d % 7) / 7.0f;
+        u[6] = (d % 13) / 13.0f;
+        u[7] = 1.0f;
+    }
+
+    glGenVertexArrays(1, &bench.vao);
+    glBindVertexArray(bench.vao);
+    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, 12);
+    glVertexAttribBinding(0, 0);
+    glVertexAttribBinding(1, 0);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glGenBuffers(1, &bench.vbo);
+    glGenBuffers(1, &bench.ubo);
+    glUseProgram(bench.prog);
+
+    streamRun(&bench, "glBufferData per draw", STREAM_BUFFER_DATA, NULL);
+    streamRun(&bench, "ring + small_memcpy", STREAM_RING, small_memcpy);
+    streamRun(&bench, "ring + this_memcpy", STREAM_RING, this_memcpy_quiet);
+    streamRun(&bench, "ring + libc memcpy", STREAM_RING, memcpy);
+
+    // the ring is idle now, the copies can go straight into it
+    glFinish();
+    streamCopyBench(&bench.ring);
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glDeleteBuffers(1, &bench.vbo);
+    glDeleteBuffers(1, &bench.ubo);
+    glDeleteVertexArrays(1, &bench.vao);
+    glDeleteProgram(bench.prog);
+    streamRingDestroy(&bench.ring);
+    free(bench.verts);
+    free(bench.uniforms);
+}
@@ -0,0 +1,27 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// frames the GPU can be behind before streamRingBeginFrame has to wait
+#define STREAM_RING_FRAMES 3
+
+struct streamRing {
+    GLuint buffer;
+    void* map;
+    size_t size;
+    size_t segmentSize;  // every frame in flight gets one segment
+    size_t head;         // next free byte, absolute offset into the buffer
+    int frame;           // segment currently being filled
+    GLsync fences[STREAM_RING_FRAMES];
+};
+
+bool streamRingInit(struct streamRing* ring, size_t size);
+void streamRingBeginFrame(struct streamRing* ring);
+void* streamRingAlloc(struct streamRing* ring, size_t size, size_t align, GLintptr* offset);
+bool streamRingWrite(struct streamRing* ring, const void* data, size_t size, size_t align, GLintptr* offset);
+void streamRingEndFrame(struct streamRing* ring);
+void streamRingDestroy(struct streamRing* ring);
+
+void runStreamRingTest();
@@ -0,0 +1,249 @@
+#include <pthread.h>
+
+#include "upload-threads.h"
+#include "copy.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Multi-stream upload engine. Every worker thread owns a couple of slices of one persistently
+ * mapped pixel unpack buffer and only ever copies frames into those, no GL calls happen there.
+ * The thread owning the GL context (the one calling this) is the consumer: it turns every
+ * finished slice into a glTexSubImage2D on that stream's texture, puts a fence behind it and
+ * hands the slice back to the worker once the fence has signaled.
+ *
+ * Every thread count from 1 to UPLOAD_MAX_THREADS gets run, so it's visible where adding
+ * threads stops helping.
+ */
+
+#define UPLOAD_WIDTH 1280
+#define UPLOAD_HEIGHT 720
+#define UPLOAD_FRAME_SIZE (UPLOAD_WIDTH*UPLOAD_HEIGHT*4)
+#define UPLOAD_MAX_THREADS 4
+#define UPLOAD_SLOTS_PER_THREAD 2
+#define UPLOAD_FRAMES_PER_THREAD 120
+
+#define UPLOAD_STORAGE_FLAGS (GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_COHERENT_BIT | GL_MAP_PERSISTENT_BIT)
+#define UPLOAD_MAP_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+enum slotState {
+    SLOT_FREE,      // worker may fill it
+    SLOT_WRITING,   // worker is copying into it
+    SLOT_READY,     // copy done, consumer has to upload it
+    SLOT_IN_FLIGHT  // upload issued, waiting for the fence
+};
+
+struct uploadSlot {
+    size_t offset;
+    int owner;
+    enum slotState state;
+    GLsync fence;
+};
+
+struct uploadEngine;
+
+struct uploadWorker {
+    pthread_t thread;
+    int index;
+    struct uploadEngine* engine;
+    void* src;
+    uint64_t copyNs;
+};
+
+struct uploadEngine {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    void* map;
+    int threads;
+    struct uploadSlot slots[UPLOAD_MAX_THREADS * UPLOAD_SLOTS_PER_THREAD];
+    struct uploadWorker workers[UPLOAD_MAX_THREADS];
+};
+
+static void* uploadWorkerMain(void* arg){
+    struct uploadWorker* worker = arg;
+    struct uploadEngine* engine = worker->engine;
+    struct uploadSlot* own = &engine->slots[worker->index * UPLOAD_SLOTS_PER_THREAD];
+
+    for(int frame = 0; frame < UPLOAD_FRAMES_PER_THREAD; frame++){
+        struct uploadSlot* slot = NULL;
+        pthread_mutex_lock(&engine->lock);
+        while(!slot){
+            for(int i = 0; i < UPLOAD_SLOTS_PER_THREAD; i++){
+                if(own[i].state == SLOT_FREE){
+                    slot = &own[i];
+                    break;
+                }
+            }
+            if(!slot){
+                pthread_cond_wait(&engine->cond, &engine->lock);
+            }
+        }
+        slot->state = SLOT_WRITING;
+        pthread_mutex_unlock(&engine->lock);
+
+        // change the data a bit every frame, so nothing can skip identical uploads
+        *(uint32_t*)worker->src = frame;
+
+        uint64_t start = nowNs();
+        this_memcpy_quiet(engine->map + slot->offset, worker->src, UPLOAD_FRAME_SIZE);
+        worker->copyNs += nowNs() - start;
+
+        pthread_mutex_lock(&engine->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&engine->cond);
+        pthread_mutex_unlock(&engine->lock);
+    }
+    return NULL;
+}
+
+// consumer side, needs the GL context. Returns how many frames got uploaded
+static int uploadConsume(struct uploadEngine* engine, GLuint* textures){
+    int slotCount = engine->threads * UPLOAD_SLOTS_PER_THREAD;
+    int total = engine->threads * UPLOAD_FRAMES_PER_THREAD;
+    int done = 0;
+
+    while(done < total){
+        struct uploadSlot* ready[UPLOAD_MAX_THREADS * UPLOAD_SLOTS_PER_THREAD];
+        int readyCount = 0;
+        int inFlight = 0;
+
+        pthread_mutex_lock(&engine->lock);
+        for(int i = 0; i < slotCount; i++){
+            if(engine->slots[i].state == SLOT_READY){
+                engine->slots[i].state = SLOT_IN_FLIGHT;
+                ready[readyCount++] = &engine->slots[i];
+            }else if(engine->slots[i].state == SLOT_IN_FLIGHT){
+                inFlight++;
+            }
+        }
+        if(readyCount == 0 && inFlight == 0){
+            // nothing to do until a worker finishes a copy
+            pthread_cond_wait(&engine->cond, &engine->lock);
+            pthread_mutex_unlock(&engine->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&engine->lock);
+
+        for(int i = 0; i < readyCount; i++){
+            glBindTexture(GL_TEXTURE_2D, textures[ready[i]->owner]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, UPLOAD_WIDTH, UPLOAD_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, (void*)ready[i]->offset);
+            ready[i]->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        // hand back whatever the GPU is done with. Only block if there was nothing new to submit
+        for(int i = 0; i < slotCount; i++){
+            struct uploadSlot* slot = &engine->slots[i];
+            if(slot->state != SLOT_IN_FLIGHT || !slot->fence){
+                continue;
+            }
+            GLuint64 timeout = readyCount == 0 ? 1000000 : 0;
+            GLenum res = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if(res == GL_WAIT_FAILED){
+                // still hand the slot back, otherwise the worker never finishes
+                printf("glClientWaitSync failed (err: %d)\n", glGetError());
+            }
+            if(res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED || res == GL_WAIT_FAILED){
+                glDeleteSync(slot->fence);
+                slot->fence = NULL;
+                pthread_mutex_lock(&engine->lock);
+                slot->state = SLOT_FREE;
+                pthread_cond_broadcast(&engine->cond);
+                pthread_mutex_unlock(&engine->lock);
+                done++;
+            }
+        }
+    }
+    return done;
+}
+
+static void uploadRun(int threads, void* map, GLuint* textures, void** sources){
+    struct uploadEngine engine;
+    memset(&engine, 0, sizeof(engine));
+    pthread_mutex_init(&engine.lock, NULL);
+    pthread_cond_init(&engine.cond, NULL);
+    engine.map = map;
+    engine.threads = threads;
+
+    for(int i = 0; i < threads * UPLOAD_SLOTS_PER_THREAD; i++){
+        engine.slots[i].offset = (size_t)i * UPLOAD_FRAME_SIZE;
+        engine.slots[i].owner = i / UPLOAD_SLOTS_PER_THREAD;
+        engine.slots[i].state = SLOT_FREE;
+    }
+
+    glFinish();
+    uint64_t start = nowNs();
+    for(int i = 0; i < threads; i++){
+        engine.workers[i].index = i;
+        engine.workers[i].engine = &engine;
+        engine.workers[i].src = sources[i];
+        pthread_create(&engine.workers[i].thread, NULL, uploadWorkerMain, &engine.workers[i]);
+    }
+
+    int done = uploadConsume(&engine, textures);
+
+    for(int i = 0; i < threads; i++){
+        pthread_join(engine.workers[i].thread, NULL);
+    }
+    glFinish();
+    uint64_t elapsed = nowNs() - start;
+
+    uint64_t copyNs = 0;
+    for(int i = 0; i < threads; i++){
+        copyNs += engine.workers[i].copyNs;
+    }
+    double perThreadCopy = mbPerSec((size_t)UPLOAD_FRAME_SIZE * UPLOAD_FRAMES_PER_THREAD * threads, copyNs);
+
+    printf("%8d %8d %14.1f %12.1f %18.1f\n", threads, done,
+        mbPerSec((size_t)UPLOAD_FRAME_SIZE * done, elapsed),
+        (double)done / ((double)elapsed / 1e9), perThreadCopy);
+    recordResult(mbPerSec((size_t)UPLOAD_FRAME_SIZE * done, elapsed), "MB/s", RESULT_HIGHER_BETTER,
+        "upload.%d threads", threads);
+
+    pthread_mutex_destroy(&engine.lock);
+    pthread_cond_destroy(&engine.cond);
+}
+
+void runUploadThreadsTest(){
+    size_t size = (size_t)UPLOAD_FRAME_SIZE * UPLOAD_SLOTS_PER_THREAD * UPLOAD_MAX_THREADS;
+
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, UPLOAD_STORAGE_FLAGS);
+    void* map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, UPLOAD_MAP_FLAGS);
+    if(!map){
+        printf("Could not map the upload buffer (err: %d)\n", glGetError());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return;
+    }
+
+    GLuint textures[UPLOAD_MAX_THREADS];
+    void* sources[UPLOAD_MAX_THREADS];
+    glGenTextures(UPLOAD_MAX_THREADS, textures);
+    // allocate the textures from client memory, not from the bound buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    for(int i = 0; i < UPLOAD_MAX_THREADS; i++){
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, UPLOAD_WIDTH, UPLOAD_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        sources[i] = malloc(UPLOAD_FRAME_SIZE);
+        memset(sources[i], 0x40 + i, UPLOAD_FRAME_SIZE);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+    printf("\nThreaded upload (%dx%d, %d frames per thread):\n", UPLOAD_WIDTH, UPLOAD_HEIGHT, UPLOAD_FRAMES_PER_THREAD);
+    printf("%8s %8s %14s %12s %18s\n", "threads", "frames", "total MB/s", "frames/s", "copy MB/s/thread");
+    for(int threads = 1; threads <= UPLOAD_MAX_THREADS; threads++){
+        uploadRun(threads, map, textures, sources);
+    }
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    glDeleteTextures(UPLOAD_MAX_THREADS, textures);
+    for(int i = 0; i < UPLOAD_MAX_THREADS; i++){
+        free(sources[i]);
+    }
+}
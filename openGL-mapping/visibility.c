@@ -0,0 +1,299 @@
+#include "visibility.h"
+#include "shaders.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * How long it takes until a CPU write into a mapping is visible to the GPU, and whether it
+ * becomes visible at all. The CPU writes a new token into the mapped buffer, a compute shader
+ * reads it back into a normal buffer.
+ *
+ * Two ways of measuring:
+ *  - dispatch: write, flush/barrier, then dispatch a shader that reads the token once and wait
+ *    on a fence. The timer query behind the dispatch says when the GPU was done reading,
+ *    the fence when the CPU found out. The token it read has to be the new one.
+ *  - poll: a shader gets dispatched first and spins on the token. Once the timer query in front
+ *    of it is available the GPU has started, the CPU writes the token and the timer query behind
+ *    the dispatch says when the shader saw it. No barrier can help here, the dispatch is already
+ *    running, so this shows what coherent actually means on the hardware.
+ *
+ * GPU timestamps get moved into the CPU's clock with an offset measured through
+ * glGetInteger64v(GL_TIMESTAMP), which is only as good as the driver's timestamp, but close
+ * enough for anything above a few microseconds.
+ */
+
+#define VISIBILITY_SAMPLES 200
+// the poll shader gives up after that many reads, the token counts as not visible then
+#define VISIBILITY_SPIN_LIMIT (1u << 24)
+// how long to wait for the poll shader to start before writing anyway
+#define VISIBILITY_START_TIMEOUT_NS 100000000ull
+
+const char* visibilityPoll_Shader =
+"#version 430\n"
+"layout (local_size_x = 1) in;\n"
+"layout (std430, binding = 0) coherent volatile readonly buffer Token { uint token; };\n"
+"layout (std430, binding = 1) buffer Result { uint observed; uint spins; };\n"
+"uniform uint expected;\n"
+"uniform uint spinLimit;\n"
+"void main(){\n"
+"uint seen = token;\n"
+"uint i = 0u;\n"
+"while(seen != expected && i < spinLimit){\n"
+"seen = token;\n"
+"i++;\n"
+"}\n"
+"observed = seen;\n"
+"spins = i;\n"
+"}";
+
+struct visibilityMapping {
+    const char* name;
+    GLbitfield flags;
+    bool explicitFlush;
+    bool barrier;
+};
+
+static const struct visibilityMapping visibilityMappings[] = {
+    { "coherent", GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT, false, true },
+    { "coherent, no barrier", GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT, false, false },
+    { "explicit flush", GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT, true, true },
+};
+
+struct visibilityState {
+    GLuint prog;
+    GLuint tokenBuffer;
+    GLuint resultBuffer;
+    GLuint queries[2];
+    volatile uint32_t* token;
+    uint32_t next;
+    int64_t gpuToCpu;   // add to a GPU timestamp to get nowNs() time
+};
+
+struct visibilityStats {
+    uint64_t visible[VISIBILITY_SAMPLES];   // write -> GPU done reading
+    uint64_t roundTrip[VISIBILITY_SAMPLES]; // write -> CPU saw the fence
+    int count;
+    int stale;
+    int finishedEarly;  // poll only: the shader was already done before the CPU wrote
+};
+
+static int compareU64(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void calibrateClock(struct visibilityState* state){
+    // a couple of tries, the one with the smallest CPU window wins
+    uint64_t bestWindow = UINT64_MAX;
+    glFinish();
+    for(int i = 0; i < 10; i++){
+        GLint64 gpu;
+        uint64_t before = nowNs();
+        glGetInteger64v(GL_TIMESTAMP, &gpu);
+        uint64_t after = nowNs();
+        if(after - before < bestWindow){
+            bestWindow = after - before;
+            state->gpuToCpu = (int64_t)(before + (after - before) / 2) - gpu;
+        }
+    }
+}
+
+static uint64_t queryCpuNs(struct visibilityState* state, GLuint query){
+    GLuint64 gpu;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpu);
+    return gpu + state->gpuToCpu;
+}
+
+// makes the CPU write visible the way the mapping is supposed to be used
+static void publish(const struct visibilityMapping* mapping){
+    if(mapping->explicitFlush){
+        glFlushMappedBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t));
+    }
+    if(mapping->barrier){
+        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    }
+}
+
+static void dispatchRead(struct visibilityState* state, uint32_t expected, uint32_t spinLimit){
+    glUseProgram(state->prog);
+    glUniform1ui(glGetUniformLocation(state->prog, "expected"), expected);
+    glUniform1ui(glGetUniformLocation(state->prog, "spinLimit"), spinLimit);
+    glQueryCounter(state->queries[0], GL_TIMESTAMP);
+    glDispatchCompute(1, 1, 1);
+    glQueryCounter(state->queries[1], GL_TIMESTAMP);
+}
+
+// returns the token the shader saw
+static uint32_t readObserved(struct visibilityState* state, uint32_t* spins){
+    uint32_t result[2];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, state->resultBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(result), result);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    if(spins){
+        *spins = result[1];
+    }
+    return result[0];
+}
+
+static void waitFence(){
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+}
+
+static void measureDispatch(struct visibilityState* state, const struct visibilityMapping* mapping, struct visibilityStats* stats){
+    for(int i = 0; i < VISIBILITY_SAMPLES; i++){
+        uint32_t expected = ++state->next;
+        uint64_t written = nowNs();
+        *state->token = expected;
+        publish(mapping);
+        dispatchRead(state, expected, 0);
+        waitFence();
+        uint64_t signaled = nowNs();
+
+        if(readObserved(state, NULL) != expected){
+            stats->stale++;
+            continue;
+        }
+        uint64_t gpuDone = queryCpuNs(state, state->queries[1]);
+        stats->visible[stats->count] = gpuDone > written ? gpuDone - written : 0;
+        stats->roundTrip[stats->count] = signaled - written;
+        stats->count++;
+    }
+}
+
+static void measurePoll(struct visibilityState* state, const struct visibilityMapping* mapping, struct visibilityStats* stats){
+    for(int i = 0; i < VISIBILITY_SAMPLES; i++){
+        uint32_t expected = ++state->next;
+        dispatchRead(state, expected, VISIBILITY_SPIN_LIMIT);
+        glFlush();
+
+        // don't write before the shader is actually spinning
+        GLint started = 0;
+        uint64_t start = nowNs();
+        while(!started && nowNs() - start < VISIBILITY_START_TIMEOUT_NS){
+            glGetQueryObjectiv(state->queries[0], GL_QUERY_RESULT_AVAILABLE, &started);
+        }
+
+        // a driver that runs the dispatch right away (llvmpipe) has spun to the limit by now
+        GLint finished = 0;
+        glGetQueryObjectiv(state->queries[1], GL_QUERY_RESULT_AVAILABLE, &finished);
+
+        uint64_t written = nowNs();
+        *state->token = expected;
+        if(finished){
+            waitFence();
+            stats->finishedEarly++;
+            continue;
+        }
+        if(mapping->explicitFlush){
+            // the only thing that can still happen while the dispatch runs, a barrier would queue behind it
+            glFlushMappedBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t));
+        }
+        waitFence();
+        uint64_t signaled = nowNs();
+
+        uint32_t spins;
+        if(readObserved(state, &spins) != expected){
+            stats->stale++;
+            continue;
+        }
+        uint64_t gpuDone = queryCpuNs(state, state->queries[1]);
+        stats->visible[stats->count] = gpuDone > written ? gpuDone - written : 0;
+        stats->roundTrip[stats->count] = signaled - written;
+        stats->count++;
+    }
+}
+
+static void report(const char* mapping, const char* mode, struct visibilityStats* stats){
+    printf("%-22s %-9s", mapping, mode);
+    if(stats->count){
+        qsort(stats->visible, stats->count, sizeof(uint64_t), compareU64);
+        qsort(stats->roundTrip, stats->count, sizeof(uint64_t), compareU64);
+        uint64_t p50 = stats->visible[stats->count / 2];
+        uint64_t p99 = stats->visible[stats->count * 99 / 100];
+        printf(" %10.1f %10.1f %10.1f %10.1f %12.1f",
+            stats->visible[0] / 1000.0, p50 / 1000.0, p99 / 1000.0,
+            stats->visible[stats->count - 1] / 1000.0, stats->roundTrip[stats->count / 2] / 1000.0);
+        recordResult(p50 / 1000.0, "us", RESULT_LOWER_BETTER, "visibility.%s %s p50", mapping, mode);
+        recordResult(p99 / 1000.0, "us", RESULT_LOWER_BETTER, "visibility.%s %s p99", mapping, mode);
+    }else{
+        printf(" %10s %10s %10s %10s %12s", "-", "-", "-", "-", "-");
+    }
+    printf(" %8d", stats->stale);
+    if(stats->finishedEarly){
+        printf("  (%d dispatches were done before the write)", stats->finishedEarly);
+    }
+    printf("\n");
+    recordResult(stats->stale, "failures", RESULT_LOWER_BETTER, "visibility.%s %s stale", mapping, mode);
+}
+
+static void runMapping(struct visibilityState* state, const struct visibilityMapping* mapping){
+    glGenBuffers(1, &state->tokenBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state->tokenBuffer);
+    // the flush bit is only valid for the mapping
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), NULL, mapping->flags & ~GL_MAP_FLUSH_EXPLICIT_BIT);
+    state->token = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), mapping->flags);
+    if(!state->token){
+        printf("%-22s could not map the token buffer (err: %d)\n", mapping->name, glGetError());
+        glDeleteBuffers(1, &state->tokenBuffer);
+        return;
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, state->tokenBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, state->resultBuffer);
+    // glFlushMappedBufferRange goes through the generic binding, which the line above changed
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state->tokenBuffer);
+    calibrateClock(state);
+
+    // everything gets compiled and allocated on the first dispatch, that shouldn't count
+    struct visibilityStats* stats = calloc(1, sizeof(*stats));
+    measureDispatch(state, mapping, stats);
+    memset(stats, 0, sizeof(*stats));
+    measureDispatch(state, mapping, stats);
+    report(mapping->name, "dispatch", stats);
+
+    // the barrier never makes it into the poll measurement, that row would be the same as coherent
+    if(mapping->barrier){
+        memset(stats, 0, sizeof(*stats));
+        measurePoll(state, mapping, stats);
+        report(mapping->name, "poll", stats);
+    }
+    free(stats);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state->tokenBuffer);
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glDeleteBuffers(1, &state->tokenBuffer);
+}
+
+void runVisibilityTest(){
+    if(!GLEW_ARB_compute_shader || !GLEW_ARB_shader_storage_buffer_object || !GLEW_ARB_timer_query){
+        printf("\nVisibility test needs compute shaders, SSBOs and timer queries\n");
+        return;
+    }
+
+    struct visibilityState state;
+    memset(&state, 0, sizeof(state));
+    state.prog = compileComputeProgram(visibilityPoll_Shader);
+    if(state.prog == 0){
+        return;
+    }
+    glGenQueries(2, state.queries);
+    glGenBuffers(1, &state.resultBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.resultBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(uint32_t), NULL, GL_DYNAMIC_READ);
+
+    printf("\nCPU write -> GPU visibility (%d samples, us):\n", VISIBILITY_SAMPLES);
+    printf("%-22s %-9s %10s %10s %10s %10s %12s %8s\n",
+        "mapping", "mode", "min", "p50", "p99", "max", "fence p50", "stale");
+    for(int i = 0; i < sizeof(visibilityMappings) / sizeof(visibilityMappings[0]); i++){
+        runMapping(&state, &visibilityMappings[i]);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glUseProgram(0);
+    glDeleteBuffers(1, &state.resultBuffer);
+    glDeleteQueries(2, state.queries);
+    glDeleteProgram(state.prog);
+}
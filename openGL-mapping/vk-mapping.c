@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+
+#include "arm64-asmtests.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * The mapping tests for Vulkan. Every host visible memory type of every device gets allocated
+ * and mapped with vkMapMemory, then the asm tests and the copy benchmark run on it.
+ * Coherent and non-coherent types usually end up on the same BAR, but with different
+ * caching, so they're all worth checking. Non-coherent types also get the flush timed.
+ *
+ * usage: vk-mapping [size in MB]
+ */
+
+#define DEFAULT_SIZE (1280*720*4)
+
+static void printTypeFlags(VkMemoryPropertyFlags flags){
+    if(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) printf(" DEVICE_LOCAL");
+    if(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) printf(" HOST_VISIBLE");
+    if(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) printf(" HOST_COHERENT");
+    if(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) printf(" HOST_CACHED");
+}
+
+static bool allocAndMap(VkDevice device, uint32_t type, VkDeviceSize size, VkDeviceMemory* mem, void** addr){
+    VkMemoryAllocateInfo allocInfo;
+    memset(&allocInfo, 0, sizeof(allocInfo));
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = type;
+
+    VkResult res = vkAllocateMemory(device, &allocInfo, NULL, mem);
+    if(res != VK_SUCCESS){
+        printf("vkAllocateMemory failed (%d)\n", res);
+        return false;
+    }
+    res = vkMapMemory(device, *mem, 0, VK_WHOLE_SIZE, 0, addr);
+    if(res != VK_SUCCESS){
+        printf("vkMapMemory failed (%d)\n", res);
+        vkFreeMemory(device, *mem, NULL);
+        return false;
+    }
+    return true;
+}
+
+static void unmapAndFree(VkDevice device, VkDeviceMemory mem){
+    vkUnmapMemory(device, mem);
+    vkFreeMemory(device, mem, NULL);
+}
+
+// non-coherent memory needs explicit flushes before the device sees CPU writes
+static void timeFlush(VkDevice device, VkDeviceMemory mem, void* addr, VkDeviceSize size){
+    VkMappedMemoryRange range;
+    memset(&range, 0, sizeof(range));
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = mem;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+
+    // plain aligned stores, libc memset may use instructions that don't work on device memory
+    for(VkDeviceSize pos = 0; pos + 8 <= size; pos += 8){
+        *(volatile uint64_t*)(addr + pos) = 0x5555555555555555ull;
+    }
+    uint64_t start = nowNs();
+    VkResult res = vkFlushMappedMemoryRanges(device, 1, &range);
+    uint64_t flushNs = nowNs() - start;
+
+    start = nowNs();
+    vkInvalidateMappedMemoryRanges(device, 1, &range);
+    uint64_t invalidateNs = nowNs() - start;
+
+    printf("flush:           %.1f us (%d), invalidate: %.1f us\n",
+        (double)flushNs / 1000.0, res, (double)invalidateNs / 1000.0);
+}
+
+static void testMemoryType(VkDevice device, VkPhysicalDeviceMemoryProperties* props, uint32_t type, VkDeviceSize size){
+    VkMemoryType* memType = &props->memoryTypes[type];
+    printf("\n\nMemory type %u (heap %u, %llu MB):", type, memType->heapIndex,
+        (unsigned long long)(props->memoryHeaps[memType->heapIndex].size / (1024*1024)));
+    printTypeFlags(memType->propertyFlags);
+    printf("\n");
+
+    if(props->memoryHeaps[memType->heapIndex].size < size){
+        printf("Heap too small, skipping\n");
+        return;
+    }
+
+    VkDeviceMemory mem;
+    void* addr;
+    if(!allocAndMap(device, type, size, &mem, &addr)){
+        return;
+    }
+    printf("Mapped at %p\n", addr);
+
+    // every memory type gets its own results
+    char backend[32];
+    snprintf(backend, sizeof(backend), "vulkan type %u", type);
+    resultsSetBackend(backend);
+
+    runAsmTests(addr + 512);
+    printf("\n\nSecond run: \n");
+    runAsmTests(addr + 256);
+    unmapAndFree(device, mem);
+
+    // fresh allocation for the copy benchmark, so the first touch still faults
+    if(!allocAndMap(device, type, size, &mem, &addr)){
+        return;
+    }
+    runCopyBench(addr, size);
+    if(!(memType->propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)){
+        timeFlush(device, mem, addr, size);
+    }
+    unmapAndFree(device, mem);
+}
+
+static void testDevice(VkPhysicalDevice physical, VkDeviceSize size){
+    VkPhysicalDeviceProperties devProps;
+    vkGetPhysicalDeviceProperties(physical, &devProps);
+    printf("\nDevice: %s\n", devProps.deviceName);
+    resultsSetRenderer(devProps.deviceName);
+
+    // memory can be allocated without ever submitting anything, but a device is still needed
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo;
+    memset(&queueInfo, 0, sizeof(queueInfo));
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = 0;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &priority;
+
+    VkDeviceCreateInfo devInfo;
+    memset(&devInfo, 0, sizeof(devInfo));
+    devInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    devInfo.queueCreateInfoCount = 1;
+    devInfo.pQueueCreateInfos = &queueInfo;
+
+    VkDevice device;
+    VkResult res = vkCreateDevice(physical, &devInfo, NULL, &device);
+    if(res != VK_SUCCESS){
+        printf("vkCreateDevice failed (%d)\n", res);
+        return;
+    }
+
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(physical, &memProps);
+    for(uint32_t i = 0; i < memProps.memoryTypeCount; i++){
+        if(memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+            testMemoryType(device, &memProps, i, size);
+        }
+    }
+
+    vkDestroyDevice(device, NULL);
+}
+
+int main(int argc, char** argv){
+    VkDeviceSize size = DEFAULT_SIZE;
+    if(argc > 1){
+        size = (VkDeviceSize)atoi(argv[1]) * 1024 * 1024;
+        if(size == 0){
+            printf("usage: %s [size in MB]\n", argv[0]);
+            return -1;
+        }
+    }
+    resultsSetTool("vk-mapping");
+
+    VkApplicationInfo appInfo;
+    memset(&appInfo, 0, sizeof(appInfo));
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Mapping test";
+    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    VkInstanceCreateInfo instInfo;
+    memset(&instInfo, 0, sizeof(instInfo));
+    instInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instInfo.pApplicationInfo = &appInfo;
+
+    VkInstance instance;
+    VkResult res = vkCreateInstance(&instInfo, NULL, &instance);
+    if(res != VK_SUCCESS){
+        printf("Could not create a Vulkan instance (%d)\n", res);
+        return -1;
+    }
+
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(instance, &count, NULL);
+    if(count == 0){
+        printf("No Vulkan devices\n");
+        vkDestroyInstance(instance, NULL);
+        return -1;
+    }
+    VkPhysicalDevice* devices = malloc(sizeof(VkPhysicalDevice) * count);
+    vkEnumeratePhysicalDevices(instance, &count, devices);
+    for(uint32_t i = 0; i < count; i++){
+        testDevice(devices[i], size);
+    }
+
+    free(devices);
+    vkDestroyInstance(instance, NULL);
+    return 0;
+}
@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/udmabuf.h>
+#include <linux/dma-buf.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <drm_fourcc.h>
+
+#include "zerocopy.h"
+#include "copy.h"
+#include "bench.h"
+#include "results.h"
+
+/*
+ * Zero copy texture path: frames get produced straight into a memfd, /dev/udmabuf turns that
+ * into a dma-buf and EGL_EXT_image_dma_buf_import makes a texture out of it, so there is no
+ * staging copy and no glTexSubImage2D at all. The price is the cache maintenance around every
+ * CPU write (DMA_BUF_IOCTL_SYNC), which gets timed separately.
+ *
+ * Compared against the usual path: produce into malloc'd memory, this_memcpy into a
+ * persistently mapped PBO, glTexSubImage2D from that.
+ *
+ * Needs an EGL context, main sets the GLFW hint for that when this test is enabled.
+ */
+
+#define ZC_WIDTH 1280
+#define ZC_HEIGHT 720
+#define ZC_FRAME_SIZE (ZC_WIDTH*ZC_HEIGHT*4)
+#define ZC_FRAMES 200
+
+typedef void (*imageTargetTexture2D)(GLenum target, void* image);
+
+struct zcTimes {
+    uint64_t produce;
+    uint64_t copy;      // staging copy, PBO path only
+    uint64_t sync;      // cache maintenance, dma-buf path only
+    uint64_t upload;    // upload (if any) + draw + glFinish
+};
+
+struct udmabuf {
+    int memfd;
+    int dmabuf;
+    void* addr;
+};
+
+static bool createUdmabuf(struct udmabuf* ub, size_t size){
+    ub->memfd = -1;
+    ub->dmabuf = -1;
+    ub->addr = NULL;
+
+    int dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if(dev < 0){
+        printf("Could not open /dev/udmabuf\n");
+        return false;
+    }
+
+    ub->memfd = memfd_create("zerocopy-frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if(ub->memfd < 0 || ftruncate(ub->memfd, size)){
+        printf("Could not create the memfd\n");
+        goto fail;
+    }
+    // udmabuf refuses memfds that could still shrink
+    if(fcntl(ub->memfd, F_ADD_SEALS, F_SEAL_SHRINK)){
+        printf("Could not seal the memfd\n");
+        goto fail;
+    }
+
+    struct udmabuf_create create;
+    memset(&create, 0, sizeof(create));
+    create.memfd = ub->memfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = size;
+    ub->dmabuf = ioctl(dev, UDMABUF_CREATE, &create);
+    if(ub->dmabuf < 0){
+        printf("UDMABUF_CREATE failed\n");
+        goto fail;
+    }
+
+    ub->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ub->memfd, 0);
+    if(ub->addr == MAP_FAILED){
+        printf("Could not map the memfd\n");
+        ub->addr = NULL;
+        goto fail;
+    }
+    close(dev);
+    return true;
+
+fail:
+    if(ub->dmabuf >= 0) close(ub->dmabuf);
+    if(ub->memfd >= 0) close(ub->memfd);
+    close(dev);
+    return false;
+}
+
+static void destroyUdmabuf(struct udmabuf* ub, size_t size){
+    munmap(ub->addr, size);
+    close(ub->dmabuf);
+    close(ub->memfd);
+}
+
+static void dmabufSync(int dmabuf, uint64_t flags){
+    struct dma_buf_sync sync = { .flags = flags };
+    if(ioctl(dmabuf, DMA_BUF_IOCTL_SYNC, &sync)){
+        printf("DMA_BUF_IOCTL_SYNC failed\n");
+    }
+}
+
+static EGLImageKHR importDmabuf(EGLDisplay display, int dmabuf){
+    PFNEGLCREATEIMAGEKHRPROC createImage = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    if(!createImage){
+        return EGL_NO_IMAGE_KHR;
+    }
+    // DRM_FORMAT_ABGR8888 is R, G, B, A in memory, same as GL_RGBA/GL_UNSIGNED_BYTE
+    EGLint attribs[] = {
+        EGL_WIDTH, ZC_WIDTH,
+        EGL_HEIGHT, ZC_HEIGHT,
+        EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_ABGR8888,
+        EGL_DMA_BUF_PLANE0_FD_EXT, dmabuf,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, ZC_WIDTH*4,
+        EGL_NONE
+    };
+    return createImage(display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+}
+
+// stands in for whatever generates the frame (decoder, camera, ...), costs the same for both paths
+static void produceFrame(void* dst, const void* src, int frame){
+    memcpy(dst, src, ZC_FRAME_SIZE);
+    *(volatile uint32_t*)dst = frame;
+}
+
+static void drawFrame(GLuint prog, GLuint vao, GLuint tex){
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindVertexArray(vao);
+    glUseProgram(prog);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glFinish();
+}
+
+static void printTimes(const char* name, struct zcTimes* t){
+    uint64_t total = t->produce + t->copy + t->sync + t->upload;
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+        (double)t->produce / ZC_FRAMES / 1000.0, (double)t->copy / ZC_FRAMES / 1000.0,
+        (double)t->sync / ZC_FRAMES / 1000.0, (double)t->upload / ZC_FRAMES / 1000.0,
+        (double)total / ZC_FRAMES / 1000.0, (double)ZC_FRAMES / ((double)total / 1e9));
+    recordResult((double)total / ZC_FRAMES / 1000.0, "us", RESULT_LOWER_BETTER, "zerocopy.%s frame", name);
+}
+
+static void runPboPath(GLuint prog, GLuint vao, const void* src, struct zcTimes* t){
+    GLuint buffer, tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ZC_WIDTH, ZC_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ZC_FRAME_SIZE, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    void* map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ZC_FRAME_SIZE, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    void* staging = malloc(ZC_FRAME_SIZE);
+
+    for(int frame = 0; frame < ZC_FRAMES; frame++){
+        uint64_t start = nowNs();
+        produceFrame(staging, src, frame);
+        uint64_t produced = nowNs();
+        this_memcpy_quiet(map, staging, ZC_FRAME_SIZE);
+        uint64_t copied = nowNs();
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ZC_WIDTH, ZC_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        drawFrame(prog, vao, tex);
+        uint64_t drawn = nowNs();
+        t->produce += produced - start;
+        t->copy += copied - produced;
+        t->upload += drawn - copied;
+    }
+
+    free(staging);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    glDeleteTextures(1, &tex);
+}
+
+static bool runDmabufPath(GLuint prog, GLuint vao, const void* src, struct zcTimes* t){
+    EGLDisplay display = eglGetCurrentDisplay();
+    if(display == EGL_NO_DISPLAY){
+        printf("No current EGL display, the zero copy path needs an EGL context\n");
+        return false;
+    }
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(!extensions || !strstr(extensions, "EGL_EXT_image_dma_buf_import")){
+        printf("EGL_EXT_image_dma_buf_import not supported\n");
+        return false;
+    }
+    imageTargetTexture2D imageTarget = (imageTargetTexture2D)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    PFNEGLDESTROYIMAGEKHRPROC destroyImage = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    if(!imageTarget || !destroyImage){
+        printf("glEGLImageTargetTexture2DOES not available\n");
+        return false;
+    }
+
+    struct udmabuf ub;
+    if(!createUdmabuf(&ub, ZC_FRAME_SIZE)){
+        return false;
+    }
+
+    EGLImageKHR image = importDmabuf(display, ub.dmabuf);
+    if(image == EGL_NO_IMAGE_KHR){
+        printf("Importing the dma-buf failed (EGL error 0x%x)\n", eglGetError());
+        destroyUdmabuf(&ub, ZC_FRAME_SIZE);
+        return false;
+    }
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    imageTarget(GL_TEXTURE_2D, image);
+    GLenum err = glGetError();
+    if(err != GL_NO_ERROR){
+        printf("glEGLImageTargetTexture2DOES failed (err: %d)\n", err);
+        // the texture has no storage, timing it would only produce bogus numbers
+        glDeleteTextures(1, &tex);
+        destroyImage(display, image);
+        destroyUdmabuf(&ub, ZC_FRAME_SIZE);
+        return false;
+    }
+
+    for(int frame = 0; frame < ZC_FRAMES; frame++){
+        uint64_t start = nowNs();
+        dmabufSync(ub.dmabuf, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+        uint64_t synced = nowNs();
+        produceFrame(ub.addr, src, frame);
+        uint64_t produced = nowNs();
+        dmabufSync(ub.dmabuf, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+        uint64_t flushed = nowNs();
+        drawFrame(prog, vao, tex);
+        uint64_t drawn = nowNs();
+        t->sync += (synced - start) + (flushed - produced);
+        t->produce += produced - synced;
+        t->upload += drawn - flushed;
+    }
+
+    glDeleteTextures(1, &tex);
+    destroyImage(display, image);
+    destroyUdmabuf(&ub, ZC_FRAME_SIZE);
+    return true;
+}
+
+void runZeroCopyTest(GLuint prog, GLuint vao){
+    void* src = malloc(ZC_FRAME_SIZE);
+    memset(src, 128, ZC_FRAME_SIZE);
+
+    struct zcTimes pbo, dmabuf;
+    memset(&pbo, 0, sizeof(pbo));
+    memset(&dmabuf, 0, sizeof(dmabuf));
+
+    runPboPath(prog, vao, src, &pbo);
+    bool haveDmabuf = runDmabufPath(prog, vao, src, &dmabuf);
+
+    printf("\nZero copy upload (%dx%d, %d frames, us per frame):\n", ZC_WIDTH, ZC_HEIGHT, ZC_FRAMES);
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n", "path", "produce", "copy", "sync", "upload", "total", "frames/s");
+    printTimes("pbo", &pbo);
+    if(haveDmabuf){
+        printTimes("udmabuf", &dmabuf);
+    }
+
+    free(src);
+}